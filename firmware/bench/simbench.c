@@ -0,0 +1,515 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <elf.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_interrupts.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+#include "../host/noise.h"
+
+/* Runs main.elf under simavr and counts the cycles spent in a set of functions, excluding the interrupts that hit
+ * while they run, together with the worst interrupt latency seen. Every figure is also given per byte written to the
+ * data IN endpoint. The result is written as JSON.
+ *
+ * simavr has no 16u2 core. The at90usb162 has the same core, memory map, vectors and USB controller, so that is the
+ * default. simavr's own model of the controller needs a host attached over vhci, so the USB registers are taken over
+ * and emulated here: the host drains every IN endpoint the moment it is committed and never sends anything, and every
+ * millisecond it starts a frame, advancing UDFNUM and raising SOFI. Once the firmware first enters loop() the device is
+ * marked as configured. That makes the figures the cost of moving the data, with no time spent waiting on the bus.
+ */
+
+#define F_CPU 16000000UL
+
+// Data space addresses on the ATmega16u2
+#define ADDR_PIND    0x29
+#define ADDR_PLLCSR  0x49
+#define ADDR_SPL     0x5D
+#define ADDR_SPH     0x5E
+#define ADDR_USBCON  0xD8
+#define ADDR_UDINT   0xE1
+#define ADDR_UDIEN   0xE2
+#define ADDR_UDFNUML 0xE4
+#define ADDR_UDFNUMH 0xE5
+#define ADDR_UEINTX  0xE8
+#define ADDR_UENUM   0xE9
+#define ADDR_UECFG1X 0xED
+#define ADDR_UESTA0X 0xEE
+#define ADDR_UEDATX  0xF1
+#define ADDR_UEBCLX  0xF2
+#define ADDR_UEINT   0xF4
+
+#define SOFI    2
+#define SOFE    2
+#define TXINI   0
+#define RWAL    5
+#define FIFOCON 7
+#define CFGOK   7
+#define PLOCK   0
+#define PLLE    1
+
+// UECFG1X of a 64 byte double banked endpoint
+#define EP_CFG1 0x36
+#define EP_SIZE 64
+#define ENDPOINTS 5
+
+#define DEVICE_STATE_Configured 4
+#define USB_GEN_VECTOR 11
+
+#define MAX_FUNCTIONS 32
+#define MAX_DEPTH 32
+#define MAX_VECTORS 64
+
+typedef struct {
+    const char *label;
+    const char *symbol;
+    uint32_t addr;
+    bool found;
+    uint64_t calls;
+    uint64_t cycles;
+} function_t;
+
+typedef struct {
+    function_t *function;
+    uint16_t sp;
+    avr_cycle_count_t start;
+    avr_cycle_count_t isr_start;
+} frame_t;
+
+static function_t functions[MAX_FUNCTIONS];
+static uint8_t function_count;
+
+static frame_t stack[MAX_DEPTH];
+static uint8_t depth;
+// Cycles spent in interrupt handlers so far, subtracted from whatever they interrupted
+static avr_cycle_count_t isr_cycles;
+// Cycles the core spent asleep, waiting for an interrupt
+static avr_cycle_count_t sleep_cycles;
+static uint16_t isr_sp;
+static avr_cycle_count_t isr_start;
+static bool in_isr;
+// 29 vectors of two words each, unless the ELF says otherwise
+static uint32_t vector_table_end = 29*4;
+
+static uint8_t stream_ep = 3;
+static uint8_t fill[ENDPOINTS];
+static uint64_t bytes_out;
+static uint64_t packets_out;
+static uint16_t frame_number;
+
+// SOFI, kept raised until the firmware clears it the way the controller does
+static avr_int_vector_t usb_gen = {
+    .enable = AVR_IO_REGBIT(ADDR_UDIEN, SOFE),
+    .raised = AVR_IO_REGBIT(ADDR_UDINT, SOFI),
+    .vector = USB_GEN_VECTOR,
+    .raise_sticky = 1,
+};
+
+static avr_cycle_count_t pending_since[MAX_VECTORS];
+static avr_cycle_count_t worst_latency;
+static uint8_t worst_vector;
+
+static noise_source_t sources[2];
+static uint8_t levels[2];
+static avr_irq_t *pins[2];
+
+static void addFunction(const char *label, const char *symbol){
+    if(function_count == MAX_FUNCTIONS)
+        return;
+    functions[function_count].label = label;
+    functions[function_count].symbol = symbol;
+    function_count++;
+}
+
+/* Looks the functions up in the ELF symbol table. simavr's own table is only there if it was built with ELF_SYMBOLS,
+ * so this reads it directly. Data symbols come back with their 0x800000 offset stripped.
+ */
+static uint32_t findSymbols(const char *path, const char *data_symbol, uint32_t *data_addr){
+    FILE *f = fopen(path, "rb");
+    if(!f){
+        perror(path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    uint8_t *elf = malloc(size);
+    if(!elf || fread(elf, 1, size, f) != (size_t)size){
+        fprintf(stderr, "%s: read error\n", path);
+        exit(1);
+    }
+    fclose(f);
+
+    Elf32_Ehdr *eh = (Elf32_Ehdr *)elf;
+    if(memcmp(eh->e_ident, ELFMAG, SELFMAG) || eh->e_ident[EI_CLASS] != ELFCLASS32){
+        fprintf(stderr, "%s: not a 32 bit ELF file\n", path);
+        exit(1);
+    }
+
+    uint32_t found = 0;
+    Elf32_Shdr *sh = (Elf32_Shdr *)(elf + eh->e_shoff);
+    for(uint16_t i=0; i<eh->e_shnum; i++){
+        if(sh[i].sh_type != SHT_SYMTAB)
+            continue;
+        Elf32_Sym *sym = (Elf32_Sym *)(elf + sh[i].sh_offset);
+        const char *names = (const char *)(elf + sh[sh[i].sh_link].sh_offset);
+        for(uint32_t j=0; j<sh[i].sh_size / sizeof(Elf32_Sym); j++){
+            const char *name = names + sym[j].st_name;
+            if(!strcmp(name, data_symbol))
+                *data_addr = sym[j].st_value & 0xFFFF;
+            if(!strcmp(name, "__vectors") && sym[j].st_size)
+                vector_table_end = sym[j].st_value + sym[j].st_size;
+            if(ELF32_ST_TYPE(sym[j].st_info) != STT_FUNC)
+                continue;
+            for(uint8_t k=0; k<function_count; k++){
+                if(!functions[k].found && !strcmp(name, functions[k].symbol)){
+                    functions[k].addr = sym[j].st_value;
+                    functions[k].found = true;
+                    found++;
+                }
+            }
+        }
+    }
+    free(elf);
+    return found;
+}
+
+static uint16_t stackPointer(avr_t *avr){
+    return avr->data[ADDR_SPL] | (avr->data[ADDR_SPH] << 8);
+}
+
+// Called before every instruction: closes the frames that have returned and opens one if pc is a function entry
+static void trace(avr_t *avr){
+    uint16_t sp = stackPointer(avr);
+
+    // A return pops the two byte return address, leaving SP above where it was on entry. The handler itself has to
+    // be closed before the interrupt, or its own cycles would be subtracted from it.
+    while(depth && sp > stack[depth-1].sp){
+        frame_t *fr = &stack[--depth];
+        fr->function->cycles += (avr->cycle - fr->start) - (isr_cycles - fr->isr_start);
+    }
+    if(in_isr && sp > isr_sp){
+        isr_cycles += avr->cycle - isr_start;
+        in_isr = false;
+    }
+
+    // Interrupt entry goes through the vector table
+    if(!in_isr && avr->pc < vector_table_end && avr->pc > 0){
+        in_isr = true;
+        isr_sp = sp;
+        isr_start = avr->cycle;
+    }
+
+    for(uint8_t i=0; i<function_count; i++){
+        function_t *fn = &functions[i];
+        if(!fn->found || fn->addr != avr->pc)
+            continue;
+        fn->calls++;
+        if(depth < MAX_DEPTH){
+            stack[depth].function = fn;
+            stack[depth].sp = sp;
+            stack[depth].start = avr->cycle;
+            stack[depth].isr_start = isr_cycles;
+            depth++;
+        }
+    }
+}
+
+static uint8_t readUEINTX(avr_t *avr, avr_io_addr_t addr, void *param){
+    uint8_t ep = avr->data[ADDR_UENUM] % ENDPOINTS;
+    // Endpoint 0 never receives a SETUP packet
+    if(!ep)
+        return 0;
+    return (1 << TXINI) | (1 << FIFOCON) | (fill[ep] < EP_SIZE ? (1 << RWAL) : 0);
+}
+
+static void writeUEINTX(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param){
+    uint8_t ep = avr->data[ADDR_UENUM] % ENDPOINTS;
+    if(ep && !(v & (1 << FIFOCON))){
+        if(ep == stream_ep)
+            packets_out++;
+        fill[ep] = 0;
+    }
+    avr->data[addr] = v;
+}
+
+static void writeUEDATX(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param){
+    uint8_t ep = avr->data[ADDR_UENUM] % ENDPOINTS;
+    if(fill[ep] < EP_SIZE){
+        fill[ep]++;
+        if(ep == stream_ep)
+            bytes_out++;
+    }
+}
+
+static uint8_t readUEBCLX(avr_t *avr, avr_io_addr_t addr, void *param){
+    return fill[avr->data[ADDR_UENUM] % ENDPOINTS];
+}
+
+static uint8_t readUESTA0X(avr_t *avr, avr_io_addr_t addr, void *param){
+    return (1 << CFGOK);
+}
+
+static uint8_t readUECFG1X(avr_t *avr, avr_io_addr_t addr, void *param){
+    return EP_CFG1;
+}
+
+static uint8_t readPLLCSR(avr_t *avr, avr_io_addr_t addr, void *param){
+    uint8_t v = avr->data[addr];
+    return (v & (1 << PLLE)) ? v | (1 << PLOCK) : v;
+}
+
+static uint8_t readUDFNUML(avr_t *avr, avr_io_addr_t addr, void *param){
+    return frame_number & 0xFF;
+}
+
+static uint8_t readUDFNUMH(avr_t *avr, avr_io_addr_t addr, void *param){
+    return (frame_number >> 8) & 0x07;
+}
+
+static uint8_t readPlain(avr_t *avr, avr_io_addr_t addr, void *param){
+    return avr->data[addr];
+}
+
+static void writePlain(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param){
+    avr->data[addr] = v;
+}
+
+/* simavr's USB model already has handlers on these, which avr_register_io_read() will not replace, so this puts the
+ * emulation in the I/O table directly
+ */
+static void takeRegister(avr_t *avr, avr_io_addr_t addr, avr_io_read_t r, avr_io_write_t w){
+    avr_io_addr_t io = AVR_DATA_TO_IO(addr);
+    avr->io[io].r.c = r ? r : readPlain;
+    avr->io[io].r.param = NULL;
+    avr->io[io].w.c = w ? w : writePlain;
+    avr->io[io].w.param = NULL;
+}
+
+// Start of a frame, once every millisecond
+static avr_cycle_count_t startFrame(avr_t *avr, avr_cycle_count_t when, void *param){
+    frame_number = (frame_number + 1) & 0x7FF;
+    avr_raise_interrupt(avr, &usb_gen);
+    return when + F_CPU/1000;
+}
+
+static avr_t *avr;
+
+static void vectorPending(avr_irq_t *irq, uint32_t value, void *param){
+    uintptr_t vector = (uintptr_t)param;
+    if(value)
+        pending_since[vector] = avr->cycle;
+}
+
+static void vectorRunning(avr_irq_t *irq, uint32_t value, void *param){
+    uintptr_t vector = (uintptr_t)param;
+    if(!value)
+        return;
+    avr_cycle_count_t latency = avr->cycle - pending_since[vector];
+    if(latency > worst_latency){
+        worst_latency = latency;
+        worst_vector = vector;
+    }
+}
+
+// rng1 on PD0 and rng2 on PD1
+static void driveNoise(){
+    double t = (double)avr->cycle / F_CPU;
+    for(uint8_t i=0; i<2; i++){
+        uint8_t level = noiseLevel(&sources[i], t);
+        if(level != levels[i]){
+            levels[i] = level;
+            avr_raise_irq(pins[i], level);
+        }
+    }
+}
+
+static void writeJSON(FILE *f, const char *elf, const char *mcu, const char *tag, avr_cycle_count_t cycles){
+    fprintf(f, "{\n");
+    fprintf(f, "  \"elf\": \"%s\",\n", elf);
+    fprintf(f, "  \"mcu\": \"%s\",\n", mcu);
+    fprintf(f, "  \"tag\": \"%s\",\n", tag);
+    fprintf(f, "  \"f_cpu\": %lu,\n", F_CPU);
+    fprintf(f, "  \"cycles\": %llu,\n", (unsigned long long)cycles);
+    fprintf(f, "  \"output_bytes\": %llu,\n", (unsigned long long)bytes_out);
+    fprintf(f, "  \"output_packets\": %llu,\n", (unsigned long long)packets_out);
+    fprintf(f, "  \"cycles_per_output_byte\": %.2f,\n", bytes_out ? (double)cycles / bytes_out : 0.0);
+    fprintf(f, "  \"isr_cycles\": %llu,\n", (unsigned long long)isr_cycles);
+    fprintf(f, "  \"sleep_cycles\": %llu,\n", (unsigned long long)sleep_cycles);
+    fprintf(f, "  \"worst_isr_latency\": {\"cycles\": %llu, \"vector\": %u},\n", (unsigned long long)worst_latency,
+            worst_vector);
+    fprintf(f, "  \"functions\": {\n");
+    for(uint8_t i=0; i<function_count; i++){
+        function_t *fn = &functions[i];
+        fprintf(f, "    \"%s\": {\"symbol\": \"%s\", \"found\": %s, \"calls\": %llu, \"cycles\": %llu, "
+                "\"cycles_per_call\": %.2f, \"cycles_per_output_byte\": %.2f}%s\n",
+                fn->label, fn->symbol, fn->found ? "true" : "false", (unsigned long long)fn->calls,
+                (unsigned long long)fn->cycles, fn->calls ? (double)fn->cycles / fn->calls : 0.0,
+                bytes_out ? (double)fn->cycles / bytes_out : 0.0, i+1 < function_count ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+}
+
+static void usage(const char *name){
+    fprintf(stderr,
+            "usage: %s [-c cycles] [-m mcu] [-e endpoint] [-1 spec] [-2 spec] [-t tag] [-f label=symbol]... [-o file] "
+            "main.elf\n"
+            "  -c  cycles to run after the device is configured, default 16000000 (1s)\n"
+            "  -m  simavr core, default at90usb162\n"
+            "  -e  number of the data IN endpoint, default 3 (CDC), 1 for VENDOR_INTERFACE builds\n"
+            "  -1, -2  configure rng1 and rng2, see host/noise.h and host/harness.c\n"
+            "  -t  free form tag for the result, e.g. the commit\n"
+            "  -f  also measure function symbol, reported as label\n"
+            "  -o  where to write the JSON result, default stdout\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    avr_cycle_count_t run_cycles = F_CPU;
+    noise_config_t configs[2] = {NOISE_DEFAULTS, NOISE_DEFAULTS};
+    const char *mcu = "at90usb162";
+    const char *tag = "";
+    const char *out_path = NULL;
+    int opt;
+
+    // TIMER0_COMPA is vector 19 on the 16u2
+    addFunction("sampler", "__vector_19");
+    addFunction("readBitsAndWhiten", "readBitsAndWhiten");
+    addFunction("extractor", "extractorFeed");
+    addFunction("healthTest", "healthTest");
+    addFunction("conditionerStep", "conditionerStep");
+    addFunction("sendData", "sendData");
+    addFunction("Endpoint_Write_Stream_LE", "Endpoint_Write_Stream_LE");
+    addFunction("Endpoint_Write_Bank_Stream_LE", "Endpoint_Write_Bank_Stream_LE");
+    addFunction("CDC_Device_Flush", "CDC_Device_Flush");
+
+    while((opt = getopt(argc, argv, "c:m:e:1:2:t:f:o:")) != -1){
+        switch(opt){
+        case 'c': run_cycles = strtoull(optarg, NULL, 0); break;
+        case 'm': mcu = optarg; break;
+        case 'e': stream_ep = strtoul(optarg, NULL, 0) % ENDPOINTS; break;
+        case '1':
+        case '2':
+            if(!noiseParse(&configs[opt - '1'], optarg)){
+                fprintf(stderr, "bad noise source spec: %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 't': tag = optarg; break;
+        case 'f': {
+            char *eq = strchr(optarg, '=');
+            if(!eq)
+                usage(argv[0]);
+            *eq = 0;
+            addFunction(optarg, eq+1);
+            break;
+        }
+        case 'o': out_path = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if(optind != argc-1)
+        usage(argv[0]);
+    const char *elf = argv[optind];
+
+    addFunction("loop", "loop");
+    function_t *loop = &functions[function_count-1];
+
+    uint32_t state_addr = 0;
+    if(!findSymbols(elf, "USB_DeviceState", &state_addr) || !state_addr){
+        fprintf(stderr, "%s: symbols not found\n", elf);
+        return 1;
+    }
+
+    elf_firmware_t fw;
+    memset(&fw, 0, sizeof(fw));
+    if(elf_read_firmware(elf, &fw)){
+        fprintf(stderr, "%s: simavr could not load it\n", elf);
+        return 1;
+    }
+    avr = avr_make_mcu_by_name(mcu);
+    if(!avr){
+        fprintf(stderr, "simavr has no core called %s\n", mcu);
+        return 1;
+    }
+    avr_init(avr);
+    avr->frequency = F_CPU;
+    avr_load_firmware(avr, &fw);
+
+    // Everything from USBCON up belongs to the controller
+    for(avr_io_addr_t addr=ADDR_USBCON; addr<=ADDR_UEINT; addr++)
+        takeRegister(avr, addr, NULL, NULL);
+    takeRegister(avr, ADDR_UEINTX, readUEINTX, writeUEINTX);
+    takeRegister(avr, ADDR_UEDATX, NULL, writeUEDATX);
+    takeRegister(avr, ADDR_UEBCLX, readUEBCLX, NULL);
+    takeRegister(avr, ADDR_UESTA0X, readUESTA0X, NULL);
+    takeRegister(avr, ADDR_UECFG1X, readUECFG1X, NULL);
+    takeRegister(avr, ADDR_PLLCSR, readPLLCSR, NULL);
+    takeRegister(avr, ADDR_UDFNUML, readUDFNUML, NULL);
+    takeRegister(avr, ADDR_UDFNUMH, readUDFNUMH, NULL);
+    avr_register_vector(avr, &usb_gen);
+
+    for(uintptr_t v=1; v<MAX_VECTORS; v++){
+        avr_irq_t *irq = v == USB_GEN_VECTOR ? usb_gen.irq : avr_get_interrupt_irq(avr, v);
+        if(!irq)
+            continue;
+        avr_irq_register_notify(irq + AVR_INT_IRQ_PENDING, vectorPending, (void *)v);
+        avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, vectorRunning, (void *)v);
+    }
+
+    pins[0] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 0);
+    pins[1] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 1);
+    noiseInit(&sources[0], &configs[0], 1);
+    noiseInit(&sources[1], &configs[1], 1 ^ 0x5DEECE66DULL);
+    for(uint8_t i=0; i<2; i++){
+        levels[i] = noiseLevel(&sources[i], 0);
+        avr_raise_irq(pins[i], levels[i]);
+    }
+
+    // Boot and USB_Init are not part of the measurement. If loop() got inlined, give them a fixed budget.
+    while(loop->found ? avr->pc != loop->addr : avr->cycle < F_CPU/10){
+        driveNoise();
+        int state = avr_run(avr);
+        if(state == cpu_Done || state == cpu_Crashed){
+            fprintf(stderr, "firmware stopped before reaching loop()\n");
+            return 1;
+        }
+    }
+    avr->data[state_addr] = DEVICE_STATE_Configured;
+    avr_cycle_timer_register(avr, F_CPU/1000, startFrame, NULL);
+    for(uint8_t i=0; i<function_count; i++){
+        functions[i].calls = 0;
+        functions[i].cycles = 0;
+    }
+    worst_latency = 0;
+
+    avr_cycle_count_t start = avr->cycle;
+    while(avr->cycle - start < run_cycles){
+        driveNoise();
+        trace(avr);
+        avr_cycle_count_t before = avr->cycle;
+        int state = avr_run(avr);
+        if(state == cpu_Sleeping)
+            sleep_cycles += avr->cycle - before;
+        if(state == cpu_Done || state == cpu_Crashed){
+            fprintf(stderr, "firmware stopped at pc 0x%04x\n", avr->pc);
+            return 1;
+        }
+    }
+
+    FILE *f = out_path ? fopen(out_path, "w") : stdout;
+    if(!f){
+        perror(out_path);
+        return 1;
+    }
+    writeJSON(f, elf, mcu, tag, avr->cycle - start);
+    if(out_path)
+        fclose(f);
+    return 0;
+}
@@ -0,0 +1,162 @@
+
+#include <avr/pgmspace.h>
+#include "conditioner.h"
+
+#if !defined(SPONGE_CONDITIONER)
+
+#if CONDITIONER_BLOCKS < 1 || CONDITIONER_BLOCKS > 3
+#error "CONDITIONER_BLOCKS must be between 1 and 3"
+#endif
+#if 64 % CONDITIONER_ROUNDS_PER_STEP || CONDITIONER_ROUNDS_PER_STEP % 8
+#error "CONDITIONER_ROUNDS_PER_STEP must be a multiple of 8 dividing 64"
+#endif
+
+static const uint32_t PROGMEM K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t PROGMEM IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+enum {
+    IDLE,
+    COMPRESSING,
+    OUTPUT,
+};
+
+static uint32_t h[8];       // chaining value
+static uint32_t v[8];       // working variables of the compression in progress
+static uint32_t w[16];      // current message block, overwritten by the rolling message schedule
+static uint8_t fill;        // bytes absorbed into w
+static uint8_t blocks;      // message blocks compressed for the current output block
+static uint8_t rnd;         // next round of the compression in progress
+static uint8_t state;
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32-(n))))
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32-(n))))
+
+/* Rotations by whole bytes are plain register moves, so every rotation is reduced to one of those plus a short shift.
+ * The sigma functions are kept out of line: inlined into the unrolled rounds they need registers the rounds have to
+ * spill to the stack for them, and they take up twice as much flash.
+ */
+static __attribute__((noinline)) uint32_t S0(uint32_t x){
+    uint32_t y = ROTR(x, 16);
+    return ROTR(x, 2) ^ ROTL(y, 3) ^ ROTL(ROTR(y, 8), 2);
+}
+
+static __attribute__((noinline)) uint32_t S1(uint32_t x){
+    uint32_t y = ROTR(x, 8);
+    return ROTL(y, 2) ^ ROTR(y, 3) ^ ROTR(ROTR(y, 16), 1);
+}
+
+static __attribute__((noinline)) uint32_t s0(uint32_t x){
+    return ROTL(ROTR(x, 8), 1) ^ ROTR(ROTR(x, 16), 2) ^ (x >> 3);
+}
+
+static __attribute__((noinline)) uint32_t s1(uint32_t x){
+    uint32_t y = ROTR(x, 16);
+    return ROTR(y, 1) ^ ROTR(y, 3) ^ ((x >> 8) >> 2);
+}
+
+#define CH(e, f, g)  ((g) ^ ((e) & ((f) ^ (g))))
+#define MAJ(a, b, c) (((a) & (b)) | ((c) & ((a) | (b))))
+
+// Rounds 16..63 extend the schedule over the slot of the word that is no longer needed
+#define SCHEDULE(i) \
+    (r < 16 ? w[i] : (w[i] += s1(w[((i)+14) & 15]) + w[((i)+9) & 15] + s0(w[((i)+1) & 15])))
+
+/* The working variables are renamed by passing their indices into v, rather than moved. They stay in v between
+ * rounds: held in registers across the unrolled rounds they do not fit the AVR's and end up spilled to the stack.
+ */
+#define ROUND(a, b, c, d, e, f, g, hh, i) do { \
+        uint32_t t1 = v[hh] + S1(v[e]) + CH(v[e], v[f], v[g]) + pgm_read_dword(&K[r+(i)]) + SCHEDULE(i + (r & 8)); \
+        v[d] += t1; \
+        v[hh] = t1 + S0(v[a]) + MAJ(v[a], v[b], v[c]); \
+        __asm__ __volatile__ ("" ::: "memory"); \
+    } while(0)
+
+static void compress(uint8_t rounds){
+    enum { a, b, c, d, e, f, g, hh };
+    uint8_t r = rnd;
+
+    do{
+        ROUND(a, b, c, d, e, f, g, hh, 0);
+        ROUND(hh, a, b, c, d, e, f, g, 1);
+        ROUND(g, hh, a, b, c, d, e, f, 2);
+        ROUND(f, g, hh, a, b, c, d, e, 3);
+        ROUND(e, f, g, hh, a, b, c, d, 4);
+        ROUND(d, e, f, g, hh, a, b, c, 5);
+        ROUND(c, d, e, f, g, hh, a, b, 6);
+        ROUND(b, c, d, e, f, g, hh, a, 7);
+        r += 8;
+        rounds -= 8;
+    }while(rounds);
+
+    rnd = r;
+}
+
+static void startCompression(){
+    for(uint8_t i=0; i<8; i++)
+        v[i] = h[i];
+    rnd = 0;
+    fill = 0;
+    state = COMPRESSING;
+}
+
+void conditionerReset(){
+    fill = 0;
+    blocks = 0;
+    state = IDLE;
+}
+
+void conditionerAbsorb(uint8_t b){
+    if(!blocks && !fill)
+        memcpy_P(h, IV, sizeof(h));
+
+    // SHA-256 is big endian, the AVR little endian
+    ((uint8_t *)w)[fill ^ 3] = b;
+    fill++;
+
+    if(blocks == CONDITIONER_BLOCKS-1 && fill == 64-9){
+        ((uint8_t *)w)[fill ^ 3] = 0x80;
+        w[14] = 0;
+        w[15] = CONDITIONER_INPUT_SIZE*8UL;
+        startCompression();
+    }else if(fill == 64){
+        startCompression();
+    }
+}
+
+bool conditionerStep(ringbuffer_t *out){
+    if(state == COMPRESSING){
+        compress(CONDITIONER_ROUNDS_PER_STEP);
+        if(rnd == 64){
+            for(uint8_t i=0; i<8; i++)
+                h[i] += v[i];
+            blocks++;
+            state = (blocks == CONDITIONER_BLOCKS) ? OUTPUT : IDLE;
+        }
+        return true;
+    }
+
+    if(state == OUTPUT){
+        if(ringbufferSpace(out) < CONDITIONER_OUTPUT_SIZE)
+            return true;
+        for(uint8_t i=0; i<CONDITIONER_OUTPUT_SIZE; i++)
+            ringbufferPush(out, ((uint8_t *)h)[i ^ 3]);
+        blocks = 0;
+        state = IDLE;
+    }
+
+    return false;
+}
+
+#endif
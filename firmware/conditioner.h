@@ -0,0 +1,71 @@
+#ifndef __CONDITIONER_H__
+#define __CONDITIONER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ringbuffer.h"
+
+#if defined(SPONGE_CONDITIONER)
+/* Sponge conditioner, built with SPONGE_CONDITIONER instead of the SHA-256 one below. The pool is the 50 byte state
+ * of Keccak-f[400], 16 bit lanes, against 128 bytes for SHA-256. Extractor output is XORed into the first
+ * SPONGE_RATE-1 bytes of the state and every full block is padded and permuted, so the pool keeps absorbing while
+ * output is waiting to be taken. Once SPONGE_RATIO input bytes per output byte have gone in and the output ring has
+ * room, CONDITIONER_OUTPUT_SIZE bytes are squeezed straight out of a permutation, a partial block being padded and
+ * permuted first, and zeroed in the state. The capacity of 256 bits keeps to the usual twice the 128 bits of output.
+ *
+ * The permutation is unrolled over constant lane indices and its rotations reduced to a byte swap and at most four
+ * single bit rotations. It is spread over several calls to conditionerStep() like the SHA-256 compression. A hand
+ * estimate, not measured, puts it at 20000 cycles (~1.3ms at 16MHz).
+ */
+#define SPONGE_ROUNDS 20
+#define SPONGE_RATE   18
+
+// Input bytes absorbed per output byte
+#ifndef SPONGE_RATIO
+#define SPONGE_RATIO 4
+#endif
+
+#ifndef SPONGE_ROUNDS_PER_STEP
+#define SPONGE_ROUNDS_PER_STEP 5
+#endif
+
+#define CONDITIONER_OUTPUT_SIZE 16
+#define SPONGE_INPUT_SIZE (SPONGE_RATIO*CONDITIONER_OUTPUT_SIZE)
+#else
+/* SHA-256 conditioner. Every CONDITIONER_INPUT_SIZE bytes of extractor output are hashed into one 32 byte block of
+ * output. The input length is chosen so the SHA-256 padding fits into the last message block, which saves one
+ * compression per output block.
+ *
+ * The compression is tuned for the AVR: constants stay in flash, the message schedule is rolled over the 16 words of
+ * the input block in place (64 bytes of SRAM instead of 256), rounds are unrolled eight at a time with the working
+ * variables renamed instead of shifted, and all rotations are split into a whole-byte rotation (register moves) and
+ * a shift by at most three bits. Compressing one 64 byte block is estimated by hand, not measured, at 30000 cycles
+ * (~1.9ms at 16MHz). To keep the main loop responsive a compression is spread over several calls to
+ * conditionerStep(), each running CONDITIONER_ROUNDS_PER_STEP rounds.
+ */
+
+// Message blocks compressed per output block; 2 gives 952 input bits per 256 output bits
+#ifndef CONDITIONER_BLOCKS
+#define CONDITIONER_BLOCKS 2
+#endif
+
+#define CONDITIONER_INPUT_SIZE  (64*CONDITIONER_BLOCKS - 9)
+#define CONDITIONER_OUTPUT_SIZE 32
+
+#ifndef CONDITIONER_ROUNDS_PER_STEP
+#define CONDITIONER_ROUNDS_PER_STEP 16
+#endif
+#endif
+
+/* Absorbs one input byte. Only allowed while conditionerStep() returns false. */
+void conditionerAbsorb(uint8_t b);
+
+/* Does a slice of pending work: compression rounds, or pushing a finished output block into out once it has room for
+ * CONDITIONER_OUTPUT_SIZE bytes. Returns true as long as work is left and no input can be absorbed.
+ */
+bool conditionerStep(ringbuffer_t *out);
+
+// Drops all absorbed input and any output that has not been pushed yet
+void conditionerReset(void);
+
+#endif//__CONDITIONER_H__
@@ -0,0 +1,89 @@
+
+#include <avr/pgmspace.h>
+#include "drbg.h"
+
+static uint32_t key[8];
+static uint32_t counter;
+static uint16_t since_reseed;
+static bool seeded;
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32-(n))))
+
+static __attribute__((noinline)) void quarterRound(uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d){
+    *a += *b; *d ^= *a; *d = ROTL(*d, 16);
+    *c += *d; *b ^= *c; *b = ROTL(*b, 12);
+    *a += *b; *d ^= *a; *d = ROTL(*d, 8);
+    *c += *d; *b ^= *c; *b = ROTL(*b, 7);
+}
+
+/* Word indices of the eight quarter rounds of a double round, a to d from the low nibble up. Looping over them keeps
+ * one quarter round's four words live at a time; unrolled, the compiler holds on to the whole state and spills most
+ * of it to the stack.
+ */
+static const uint16_t PROGMEM QR[8] = {
+    0xC840, 0xD951, 0xEA62, 0xFB73, 0xFA50, 0xCB61, 0xD872, 0xE943,
+};
+
+// The 20 rounds, in place. Only block() calls it, host/kat.c also runs it on a state with a full 96 bit nonce.
+static void rounds(uint32_t x[16]){
+    for(uint8_t i=0; i<10; i++){
+        for(uint8_t j=0; j<8; j++){
+            uint16_t q = pgm_read_word(&QR[j]);
+            quarterRound(&x[q & 15], &x[(q >> 4) & 15], &x[(q >> 8) & 15], &x[q >> 12]);
+        }
+    }
+}
+
+/* The input state is never stored, it is rebuilt from key and counter for the final addition. x is the only buffer,
+ * and it belongs to the caller.
+ */
+static void block(uint32_t x[16], uint32_t n, uint32_t nonce){
+    x[0] = 0x61707865; x[1] = 0x3320646e; x[2] = 0x79622d32; x[3] = 0x6b206574;
+    for(uint8_t i=0; i<8; i++)
+        x[4+i] = key[i];
+    x[12] = n;
+    x[13] = nonce;
+    x[14] = 0;
+    x[15] = 0;
+
+    rounds(x);
+
+    x[0] += 0x61707865; x[1] += 0x3320646e; x[2] += 0x79622d32; x[3] += 0x6b206574;
+    for(uint8_t i=0; i<8; i++)
+        x[4+i] += key[i];
+    x[12] += n;
+    x[13] += nonce;
+}
+
+bool drbgWantsSeed(){
+    return !seeded || since_reseed >= DRBG_RESEED_INTERVAL;
+}
+
+void drbgReseed(ringbuffer_t *seed, uint32_t x[DRBG_BLOCK_SIZE/4]){
+    for(uint8_t i=0; i<DRBG_SEED_SIZE; i++)
+        ((uint8_t *)key)[i] ^= ringbufferPop(seed);
+
+    block(x, 0, 1);
+    // The new key is not left behind in the caller's buffer
+    for(uint8_t i=0; i<8; i++){
+        key[i] = x[i];
+        x[i] = 0;
+    }
+    counter = 0;
+    since_reseed = 0;
+    seeded = true;
+}
+
+void drbgRequireReseed(){
+    since_reseed = DRBG_MAX_BLOCKS;
+}
+
+bool drbgGenerate(uint32_t out[DRBG_BLOCK_SIZE/4]){
+    if(!seeded || since_reseed >= DRBG_MAX_BLOCKS)
+        return false;
+
+    block(out, counter, 0);
+    counter++;
+    since_reseed++;
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef __DRBG_H__
+#define __DRBG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ringbuffer.h"
+
+/* ChaCha20 based DRBG for hosts that need more than the noise sources deliver. Output is the ChaCha20 keystream
+ * (RFC 7539 block function, nonce 0) under a 256 bit key taken from the conditioned noise. Every
+ * DRBG_RESEED_INTERVAL blocks the key is replaced: 32 fresh bytes of conditioned noise are XORed into it, the first
+ * 32 bytes of the keystream block under a separate nonce become the new key, and the block counter restarts.
+ * Earlier output can therefore not be recomputed from a later key. If no fresh noise has been available
+ * for DRBG_MAX_BLOCKS blocks, output stops until the next reseed.
+ *
+ * Generating one 64 byte block is estimated at ~17000 cycles on the 16MHz AVR, i.e. roughly 60kB/s.
+ */
+
+#define DRBG_BLOCK_SIZE 64
+#define DRBG_SEED_SIZE  32
+
+#ifndef DRBG_RESEED_INTERVAL
+#define DRBG_RESEED_INTERVAL 256
+#endif
+
+#ifndef DRBG_MAX_BLOCKS
+#define DRBG_MAX_BLOCKS (4*DRBG_RESEED_INTERVAL)
+#endif
+
+// True once the DRBG has been reseeded DRBG_RESEED_INTERVAL blocks ago or has never been seeded
+bool drbgWantsSeed(void);
+
+/* Pops DRBG_SEED_SIZE bytes of conditioned noise from seed, which has to hold that many, and mixes them into the key.
+ * x is scratch space for the new key. It may be the storage behind seed: the seed is used up before x is written.
+ */
+void drbgReseed(ringbuffer_t *seed, uint32_t x[DRBG_BLOCK_SIZE/4]);
+
+/* Stops output until the next reseed, for when the noise the current key came from can no longer be trusted. The key
+ * stays and has the next seed mixed into it.
+ */
+void drbgRequireReseed(void);
+
+/* Writes the next keystream block to out. Returns false and leaves out untouched if the DRBG is not seeded or has
+ * gone DRBG_MAX_BLOCKS blocks without a reseed.
+ */
+bool drbgGenerate(uint32_t out[DRBG_BLOCK_SIZE/4]);
+
+#endif//__DRBG_H__
@@ -0,0 +1,34 @@
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+#include <stdbool.h>
+#include <avr/io.h>
+
+/* Work for the main loop, one bit per event in GPIOR0. It sits in the low I/O space, so an ISR raises an event with a
+ * single sbi and loop() tests and clears it with sbis and cbi, none of which needs interrupts disabled. loop() only
+ * runs the tasks whose event is pending, and main() sleeps while none is.
+ */
+#define EVENT_FLAGS GPIOR0
+
+enum {
+    EVENT_Samples = 0, // the sampler pushed a raw sample byte
+    EVENT_Stream  = 1, // the stream endpoint may have room, a bank was just committed
+    EVENT_Setup   = 2, // a SETUP packet is waiting on the control endpoint, DEFERRED_CONTROL only
+    EVENT_Frame   = 3, // start of frame, the stream commits for the frame are planned
+};
+
+#define eventRaise(e) (EVENT_FLAGS |= (1 << (e)))
+
+/* Clears the event and returns whether it was pending. Always inlined: only with e a constant does the clear compile to
+ * a cbi. Out of line (the firmware is built with -fno-inline-small-functions) it is an in, and, out sequence, and an
+ * event an ISR raises in between is lost.
+ */
+static inline bool eventTake(uint8_t e) __attribute__((always_inline));
+static inline bool eventTake(uint8_t e){
+    if(!(EVENT_FLAGS & (1 << e)))
+        return false;
+    EVENT_FLAGS &= ~(1 << e);
+    return true;
+}
+
+#endif//__EVENTS_H__
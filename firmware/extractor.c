@@ -0,0 +1,47 @@
+
+#include <avr/pgmspace.h>
+#include "extractor.h"
+
+/* Indexed by a byte of raw bit pairs: low nibble holds the output bits (first pair in bit 0), high nibble their
+ * count.
+ */
+static const uint8_t PROGMEM vn_table[256] = {
+    0x00, 0x11, 0x10, 0x00, 0x11, 0x23, 0x22, 0x11, 0x10, 0x21, 0x20, 0x10, 0x00, 0x11, 0x10, 0x00,
+    0x11, 0x23, 0x22, 0x11, 0x23, 0x37, 0x36, 0x23, 0x22, 0x35, 0x34, 0x22, 0x11, 0x23, 0x22, 0x11,
+    0x10, 0x21, 0x20, 0x10, 0x21, 0x33, 0x32, 0x21, 0x20, 0x31, 0x30, 0x20, 0x10, 0x21, 0x20, 0x10,
+    0x00, 0x11, 0x10, 0x00, 0x11, 0x23, 0x22, 0x11, 0x10, 0x21, 0x20, 0x10, 0x00, 0x11, 0x10, 0x00,
+    0x11, 0x23, 0x22, 0x11, 0x23, 0x37, 0x36, 0x23, 0x22, 0x35, 0x34, 0x22, 0x11, 0x23, 0x22, 0x11,
+    0x23, 0x37, 0x36, 0x23, 0x37, 0x4F, 0x4E, 0x37, 0x36, 0x4D, 0x4C, 0x36, 0x23, 0x37, 0x36, 0x23,
+    0x22, 0x35, 0x34, 0x22, 0x35, 0x4B, 0x4A, 0x35, 0x34, 0x49, 0x48, 0x34, 0x22, 0x35, 0x34, 0x22,
+    0x11, 0x23, 0x22, 0x11, 0x23, 0x37, 0x36, 0x23, 0x22, 0x35, 0x34, 0x22, 0x11, 0x23, 0x22, 0x11,
+    0x10, 0x21, 0x20, 0x10, 0x21, 0x33, 0x32, 0x21, 0x20, 0x31, 0x30, 0x20, 0x10, 0x21, 0x20, 0x10,
+    0x21, 0x33, 0x32, 0x21, 0x33, 0x47, 0x46, 0x33, 0x32, 0x45, 0x44, 0x32, 0x21, 0x33, 0x32, 0x21,
+    0x20, 0x31, 0x30, 0x20, 0x31, 0x43, 0x42, 0x31, 0x30, 0x41, 0x40, 0x30, 0x20, 0x31, 0x30, 0x20,
+    0x10, 0x21, 0x20, 0x10, 0x21, 0x33, 0x32, 0x21, 0x20, 0x31, 0x30, 0x20, 0x10, 0x21, 0x20, 0x10,
+    0x00, 0x11, 0x10, 0x00, 0x11, 0x23, 0x22, 0x11, 0x10, 0x21, 0x20, 0x10, 0x00, 0x11, 0x10, 0x00,
+    0x11, 0x23, 0x22, 0x11, 0x23, 0x37, 0x36, 0x23, 0x22, 0x35, 0x34, 0x22, 0x11, 0x23, 0x22, 0x11,
+    0x10, 0x21, 0x20, 0x10, 0x21, 0x33, 0x32, 0x21, 0x20, 0x31, 0x30, 0x20, 0x10, 0x21, 0x20, 0x10,
+    0x00, 0x11, 0x10, 0x00, 0x11, 0x23, 0x22, 0x11, 0x10, 0x21, 0x20, 0x10, 0x00, 0x11, 0x10, 0x00,
+};
+
+static const uint8_t PROGMEM pow2[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+static uint16_t acc;
+static uint8_t nbits;
+
+bool extractorFeed(uint8_t raw, uint8_t *out){
+    uint8_t e = pgm_read_byte(&vn_table[raw]);
+    acc |= (uint16_t)(uint8_t)(e & 0x0F) * pgm_read_byte(&pow2[nbits]);
+    nbits += e>>4;
+    if(nbits < 8)
+        return false;
+    *out = acc;
+    acc >>= 8;
+    nbits -= 8;
+    return true;
+}
+
+void extractorReset(){
+    acc = 0;
+    nbits = 0;
+}
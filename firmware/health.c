@@ -0,0 +1,115 @@
+
+#include <avr/pgmspace.h>
+#include "health.h"
+#include "sampler.h"
+
+typedef struct {
+    uint8_t last;       // most recent sample
+    uint8_t run;        // length of the current run of identical samples
+    uint16_t ones;      // ones seen in the current APT window
+    uint16_t n;         // samples seen in the current APT window
+    uint8_t failed;     // HEALTH_* bits raised during the current APT window
+} channel_t;
+
+/* Indexed by four consecutive samples of one channel, oldest in bit 3: the length of the run starting at the oldest
+ * sample in the high nibble, the length of the run ending at the newest sample in the low nibble.
+ */
+static const uint8_t PROGMEM runs[16] = {
+    0x44, 0x31, 0x21, 0x22, 0x12, 0x11, 0x11, 0x13, 0x13, 0x11, 0x11, 0x12, 0x22, 0x21, 0x31, 0x44
+};
+
+static const uint8_t PROGMEM popcount[16] = {
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+};
+
+static channel_t rng1, rng2;
+// Samples in the current APT window in which rng1 and rng2 differ
+static uint16_t differ;
+uint8_t health_status;
+uint8_t health_failures;
+
+static void countFailure(){
+    if(health_failures != 0xFF)
+        health_failures++;
+}
+
+static void fail(channel_t *c, uint8_t bit){
+    c->failed |= bit;
+    health_status |= bit;
+    countFailure();
+}
+
+// nib holds four samples of one channel, oldest in bit 3
+static void testChannel(channel_t *c, uint8_t nib, uint8_t rct){
+    uint8_t r = pgm_read_byte(&runs[nib]);
+    uint8_t head = r>>4;
+
+    // RCT: the run carried over from the last byte may continue into this one
+    if((nib>>3) == c->last)
+        c->run += head;
+    else
+        c->run = head;
+    if(c->run >= HEALTH_RCT_CUTOFF){
+        fail(c, rct);
+        c->run = 0;
+    }
+    if(head != 4)
+        c->run = r & 0x0F;
+    c->last = nib & 1;
+
+    /* APT: for a binary source, counting matches of the window's first sample is the same as checking that
+     * neither ones nor zeros reach the cutoff.
+     */
+    c->ones += pgm_read_byte(&popcount[nib]);
+    c->n += 4;
+}
+
+static void endWindow(channel_t *c, uint8_t apt, uint8_t mask){
+    if(c->ones >= HEALTH_APT_CUTOFF || c->ones <= HEALTH_APT_WINDOW-HEALTH_APT_CUTOFF)
+        fail(c, apt);
+    health_status = (health_status & ~mask) | c->failed;
+    c->failed = 0;
+    c->ones = 0;
+    c->n = 0;
+}
+
+/* Runs at the end of an APT window, before the channels' counts are reset. With n11 = (ones1 + ones2 - differ) / 2,
+ * d is 2 * window * (n11 - ones1 * ones2 / window).
+ */
+static void testIndependence(){
+    int32_t d = (int32_t)(uint16_t)(rng1.ones + rng2.ones - differ) * HEALTH_APT_WINDOW
+                - 2 * (int32_t)((uint32_t)rng1.ones * rng2.ones);
+    int32_t cutoff = 2L * HEALTH_APT_WINDOW * HEALTH_ICT_CUTOFF;
+
+    if(d >= cutoff || d <= -cutoff){
+        health_status |= HEALTH_ICT;
+        countFailure();
+    }else{
+        health_status &= ~HEALTH_ICT;
+    }
+    differ = 0;
+}
+
+// Gathers every other bit of x into a nibble, bit 6 ending up in bit 3
+static inline uint8_t compress(uint8_t x){
+    x &= 0x55;
+    x = (x | x>>1) & 0x33;
+    return (x | x>>2) & 0x0F;
+}
+
+uint8_t healthTest(uint8_t raw){
+    uint8_t a = compress(raw>>RNG1_BIT);
+    uint8_t b = compress(raw>>RNG2_BIT);
+
+    testChannel(&rng1, a, HEALTH_RNG1_RCT);
+    testChannel(&rng2, b, HEALTH_RNG2_RCT);
+    differ += pgm_read_byte(&popcount[a ^ b]);
+
+    // Both channels' windows end together
+    if(rng1.n == HEALTH_APT_WINDOW){
+        testIndependence();
+        endWindow(&rng1, HEALTH_RNG1_APT, HEALTH_RNG1_RCT|HEALTH_RNG1_APT);
+        endWindow(&rng2, HEALTH_RNG2_APT, HEALTH_RNG2_RCT|HEALTH_RNG2_APT);
+    }
+    return health_status;
+}
@@ -0,0 +1,43 @@
+#ifndef __HEALTH_H__
+#define __HEALTH_H__
+
+#include <stdint.h>
+
+/* Continuous health tests after NIST SP 800-90B section 4.4, run separately on rng1 and rng2. Both tests assume an
+ * assessed min-entropy of H = 0.5 bits per raw sample and a false positive probability of alpha = 2^-20.
+ *
+ * On top of that the Independence Test checks the assumption the extractor relies on, that the two channels are
+ * independent, e.g. not coupled through the supply. Over every APT window it counts the samples in which the channels
+ * differ and from that the samples in which both are 1, n11, and compares n11 against ones1 * ones2 / window, what
+ * independent channels with the same bias would give. With both channels unbiased n11 has a standard deviation of
+ * sqrt(window / 16) = 8, and the cutoff of 40 is 5 of them, which two-sided comes to about alpha = 2^-20 again.
+ */
+
+// Repetition Count Test cutoff, 1 + ceil(20/H)
+#define HEALTH_RCT_CUTOFF 41
+// Adaptive Proportion Test window and cutoff, 1 + CRITBINOM(1024, 2^-H, 1-alpha)
+#define HEALTH_APT_WINDOW 1024
+#define HEALTH_APT_CUTOFF 793
+// Independence Test cutoff for |n11 - ones1 * ones2 / window|
+#define HEALTH_ICT_CUTOFF 40
+
+#define HEALTH_RNG1_RCT 0x01
+#define HEALTH_RNG1_APT 0x02
+#define HEALTH_RNG2_RCT 0x04
+#define HEALTH_RNG2_APT 0x08
+#define HEALTH_ICT      0x10
+
+/* Set of HEALTH_* bits for the tests that failed. A channel's bits are only cleared again once that channel has
+ * completed a full APT window without any failure, HEALTH_ICT once a window passes the Independence Test. Output must
+ * be withheld while this is non-zero.
+ */
+extern uint8_t health_status;
+// Total number of test failures, saturating
+extern uint8_t health_failures;
+
+/* Runs both tests on the four samples of each channel in a raw sample byte and returns the updated health_status.
+ * Costs the same for every input byte.
+ */
+uint8_t healthTest(uint8_t raw);
+
+#endif//__HEALTH_H__
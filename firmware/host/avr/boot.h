@@ -0,0 +1,4 @@
+#ifndef __HOST_AVR_BOOT_H__
+#define __HOST_AVR_BOOT_H__
+
+#endif//__HOST_AVR_BOOT_H__
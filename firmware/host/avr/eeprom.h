@@ -0,0 +1,14 @@
+#ifndef __HOST_AVR_EEPROM_H__
+#define __HOST_AVR_EEPROM_H__
+
+#include <stdint.h>
+
+// An erased EEPROM, writes are dropped
+static inline uint8_t eeprom_read_byte(const uint8_t *p){
+    return 0xFF;
+}
+
+static inline void eeprom_update_byte(uint8_t *p, uint8_t v){
+}
+
+#endif//__HOST_AVR_EEPROM_H__
@@ -0,0 +1,19 @@
+#ifndef __HOST_AVR_INTERRUPT_H__
+#define __HOST_AVR_INTERRUPT_H__
+
+#include <avr/io.h>
+
+/* Interrupt handlers become plain functions named after their vector, the harness calls them whenever the modelled
+ * peripheral would raise the interrupt. Nothing ever preempts the main loop.
+ */
+#define ISR(vector, ...) void vector(void); void vector(void)
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define EMPTY_INTERRUPT(vector) void vector(void); void vector(void){}
+
+#define sei() (SREG |= (1 << SREG_I))
+#define cli() (SREG &= ~(1 << SREG_I))
+#define reti() return
+
+#endif//__HOST_AVR_INTERRUPT_H__
@@ -0,0 +1,251 @@
+#ifndef __HOST_AVR_IO_H__
+#define __HOST_AVR_IO_H__
+
+/* Register file of the ATmega16u2 for the host build. Registers without side effects are plain variables (defined in
+ * registers.c). The USB endpoint registers are banked by UENUM and some of them change state when read or written, so
+ * those go through the controller model in usbmodel.c.
+ */
+
+#include <stdint.h>
+#include "usbmodel.h"
+
+#define HOST_REGISTER(name) extern volatile uint8_t name;
+
+HOST_REGISTER(SREG)
+HOST_REGISTER(MCUSR)
+HOST_REGISTER(MCUCR)
+HOST_REGISTER(SMCR)
+HOST_REGISTER(CLKPR)
+HOST_REGISTER(PRR0)
+HOST_REGISTER(PRR1)
+HOST_REGISTER(GPIOR0)
+HOST_REGISTER(GPIOR1)
+HOST_REGISTER(GPIOR2)
+
+HOST_REGISTER(PINB)
+HOST_REGISTER(DDRB)
+HOST_REGISTER(PORTB)
+HOST_REGISTER(PINC)
+HOST_REGISTER(DDRC)
+HOST_REGISTER(PORTC)
+HOST_REGISTER(PIND)
+HOST_REGISTER(DDRD)
+HOST_REGISTER(PORTD)
+
+HOST_REGISTER(EICRA)
+HOST_REGISTER(EICRB)
+HOST_REGISTER(EIMSK)
+HOST_REGISTER(EIFR)
+HOST_REGISTER(PCICR)
+HOST_REGISTER(PCIFR)
+HOST_REGISTER(PCMSK0)
+HOST_REGISTER(PCMSK1)
+
+HOST_REGISTER(TCCR0A)
+HOST_REGISTER(TCCR0B)
+HOST_REGISTER(TCNT0)
+HOST_REGISTER(OCR0A)
+HOST_REGISTER(OCR0B)
+HOST_REGISTER(TIMSK0)
+HOST_REGISTER(TIFR0)
+
+HOST_REGISTER(TCCR1A)
+HOST_REGISTER(TCCR1B)
+HOST_REGISTER(TCCR1C)
+HOST_REGISTER(TIMSK1)
+HOST_REGISTER(TIFR1)
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t ICR1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint16_t OCR1C;
+
+HOST_REGISTER(ACSR)
+HOST_REGISTER(DIDR1)
+
+HOST_REGISTER(REGCR)
+HOST_REGISTER(USBCON)
+HOST_REGISTER(USBSTA)
+HOST_REGISTER(USBINT)
+HOST_REGISTER(UDCON)
+HOST_REGISTER(UDINT)
+HOST_REGISTER(UDIEN)
+HOST_REGISTER(UDADDR)
+HOST_REGISTER(UDMFN)
+HOST_REGISTER(UENUM)
+HOST_REGISTER(UERST)
+HOST_REGISTER(UEINT)
+HOST_REGISTER(UEBCHX)
+HOST_REGISTER(UESTA1X)
+extern volatile uint16_t UDFNUM;
+
+// Banked by UENUM, see usbmodel.h
+#define UECONX  (usbmodelEndpoint()->ueconx)
+#define UECFG0X (usbmodelEndpoint()->uecfg0x)
+#define UECFG1X (usbmodelEndpoint()->uecfg1x)
+#define UEIENX  (usbmodelEndpoint()->ueienx)
+#define UEINTX  (usbmodelEndpoint()->ueintx)
+#define UESTA0X (usbmodelEndpoint()->uesta0x)
+#define UEBCLX  (usbmodelEndpoint()->uebclx)
+#define UEDATX  (*usbmodelUEDATX())
+#define PLLCSR  (*usbmodelPLLCSR())
+
+// SREG
+#define SREG_I  7
+
+// MCUSR, MCUCR
+#define PORF    0
+#define EXTRF   1
+#define BORF    2
+#define WDRF    3
+#define IVCE    0
+#define IVSEL   1
+#define PUD     4
+
+// SMCR
+#define SE      0
+#define SM0     1
+#define SM1     2
+#define SM2     3
+
+// PRR0, PRR1
+#define PRSPI   2
+#define PRTIM1  3
+#define PRTIM0  5
+#define PRUSART1 0
+#define PRUSB   7
+
+// EICRA, EIMSK, EIFR, PCICR
+#define ISC00   0
+#define ISC01   1
+#define ISC10   2
+#define ISC11   3
+#define INT0    0
+#define INT1    1
+#define INTF0   0
+#define INTF1   1
+#define PCIE0   0
+#define PCIE1   1
+
+// TCCR0A, TCCR0B, TIMSK0, TIFR0
+#define WGM00   0
+#define WGM01   1
+#define CS00    0
+#define CS01    1
+#define CS02    2
+#define WGM02   3
+#define TOIE0   0
+#define OCIE0A  1
+#define OCIE0B  2
+#define TOV0    0
+#define OCF0A   1
+#define OCF0B   2
+
+// TCCR1A, TCCR1B, TIMSK1, TIFR1
+#define WGM10   0
+#define WGM11   1
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define WGM12   3
+#define WGM13   4
+#define ICES1   6
+#define ICNC1   7
+#define TOIE1   0
+#define OCIE1A  1
+#define OCIE1B  2
+#define ICIE1   5
+#define TOV1    0
+#define OCF1A   1
+#define OCF1B   2
+#define ICF1    5
+
+// ACSR, DIDR1
+#define ACIS0   0
+#define ACIS1   1
+#define ACIC    2
+#define ACIE    3
+#define ACI     4
+#define ACO     5
+#define ACBG    6
+#define ACD     7
+#define AIN0D   0
+#define AIN1D   1
+
+// PLLCSR
+#define PLOCK   0
+#define PLLE    1
+#define PLLP0   2
+#define PLLP1   3
+#define PLLP2   4
+
+// REGCR, USBCON
+#define REGDIS  0
+#define FRZCLK  5
+#define USBE    7
+
+// UDCON, UDINT, UDIEN, UDADDR
+#define DETACH  0
+#define RMWKUP  1
+#define RSTCPU  2
+#define SUSPI   0
+#define SOFI    2
+#define EORSTI  3
+#define WAKEUPI 4
+#define EORSMI  5
+#define UPRSMI  6
+#define SUSPE   0
+#define SOFE    2
+#define EORSTE  3
+#define WAKEUPE 4
+#define EORSME  5
+#define UPRSME  6
+#define ADDEN   7
+
+// UECONX, UECFG0X, UECFG1X
+#define EPEN    0
+#define RSTDT   3
+#define STALLRQC 4
+#define STALLRQ 5
+#define EPDIR   0
+#define EPTYPE0 6
+#define EPTYPE1 7
+#define ALLOC   1
+#define EPBK0   2
+#define EPBK1   3
+#define EPSIZE0 4
+#define EPSIZE1 5
+#define EPSIZE2 6
+
+// UESTA0X, UESTA1X
+#define NBUSYBK0 0
+#define NBUSYBK1 1
+#define DTSEQ0  2
+#define DTSEQ1  3
+#define UNDERFI 5
+#define OVERFI  6
+#define CFGOK   7
+#define CURRBK0 0
+#define CURRBK1 1
+#define CTRLDIR 2
+
+// UEINTX, UEIENX
+#define TXINI   0
+#define STALLEDI 1
+#define RXOUTI  2
+#define RXSTPI  3
+#define NAKOUTI 4
+#define RWAL    5
+#define NAKINI  6
+#define FIFOCON 7
+#define TXINE   0
+#define STALLEDE 1
+#define RXOUTE  2
+#define RXSTPE  3
+#define NAKOUTE 4
+#define NAKINE  6
+#define FLERRE  7
+
+#define _BV(bit) (1 << (bit))
+
+#endif//__HOST_AVR_IO_H__
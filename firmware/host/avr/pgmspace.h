@@ -0,0 +1,16 @@
+#ifndef __HOST_AVR_PGMSPACE_H__
+#define __HOST_AVR_PGMSPACE_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// There is only one address space on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define pgm_read_word(p)  (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif//__HOST_AVR_PGMSPACE_H__
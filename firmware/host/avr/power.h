@@ -0,0 +1,7 @@
+#ifndef __HOST_AVR_POWER_H__
+#define __HOST_AVR_POWER_H__
+
+#define clock_div_1 0
+#define clock_prescale_set(div) ((void)(div))
+
+#endif//__HOST_AVR_POWER_H__
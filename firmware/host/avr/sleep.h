@@ -0,0 +1,10 @@
+#ifndef __HOST_AVR_SLEEP_H__
+#define __HOST_AVR_SLEEP_H__
+
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode) ((void)(mode))
+#define sleep_enable()  ((void)0)
+#define sleep_disable() ((void)0)
+#define sleep_cpu()     ((void)0)
+
+#endif//__HOST_AVR_SLEEP_H__
@@ -0,0 +1,7 @@
+#ifndef __HOST_AVR_WDT_H__
+#define __HOST_AVR_WDT_H__
+
+#define wdt_disable() ((void)0)
+#define wdt_reset()   ((void)0)
+
+#endif//__HOST_AVR_WDT_H__
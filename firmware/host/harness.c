@@ -0,0 +1,424 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <avr/io.h>
+#include "usbmodel.h"
+#include "noise.h"
+#include "srsly/Descriptors.h"
+#include "main.h"
+#include "sampler.h"
+#include "health.h"
+#include "trace.h"
+#include "events.h"
+
+/* Runs the firmware against the USB controller model: enumerates it like a host would, then alternates between
+ * sampler interrupts, passes through loop() and USB frames in which the host drains the IN endpoints. This models
+ * what happens, not how long it takes: the ratio of samples to loop passes to frames is fixed by the options below.
+ */
+
+void TIMER0_COMPA_vect(void);
+#if defined(TRACE)
+void TIMER1_OVF_vect(void);
+#endif
+
+#if defined(VENDOR_INTERFACE)
+#define STREAM_EPADDR VENDOR_TX_EPADDR
+#else
+#define STREAM_EPADDR CDC_TX_EPADDR
+#endif
+
+static noise_source_t rng1, rng2;
+
+static FILE *out;
+static FILE *trace_out;
+static uint32_t frames_run;
+static uint64_t loops;
+static uint64_t idle_loops; // passes with no event pending, main() would have slept through them
+static uint64_t samples;
+static double sampler_time; // seconds since power up, the time base of the noise sources
+static double sample_debt;  // sampler interrupts due but not run yet
+static uint64_t received;
+static uint64_t packets;
+static uint64_t overruns;
+static uint8_t last_overruns;
+static uint32_t loops_per_frame = 25;
+static uint32_t samples_per_loop = 4;
+static bool turnaround;
+static bool notifications_unread;
+static double coupling;
+static uint32_t stalled;
+static uint32_t longest_stall;
+
+// What -e asserts about the run, -1 where nothing is
+static int64_t max_overruns = -1;
+static int8_t expect_health = -1; // 0 for a clean health status, 1 for a failed one
+static double min_throughput = -1;
+
+// One USB frame: the host polls every IN endpoint until it NAKs
+static void frame(){
+    uint8_t buf[64];
+    int16_t len;
+
+    usbmodelStartOfFrame();
+    while((len = usbmodelReadIN(STREAM_EPADDR, buf)) >= 0){
+        if(out)
+            fwrite(buf, 1, len, out);
+        received += len;
+        packets++;
+    }
+#if !defined(VENDOR_INTERFACE)
+    while(!notifications_unread && usbmodelReadIN(CDC_NOTIFICATION_EPADDR, buf) >= 0);
+#endif
+
+    overruns += (uint8_t)(sampler_overruns - last_overruns);
+    last_overruns = sampler_overruns;
+    frames_run++;
+}
+
+// One sampler interrupt, with the noise sources at the time it happens
+static void sample(){
+    double t = sampler_time;
+    sampler_time += (OCR0A + 1) / (double)SAMPLER_CLOCK_HZ;
+    uint8_t level1 = noiseLevel(&rng1, t);
+    uint8_t level2 = noiseLevel(&rng2, t);
+    if(coupling > 0 && drand48() < coupling)
+        level2 = level1;
+    RNG_PIN = (RNG_PIN & ~RNG_MASK) | (level1 << RNG1_BIT) | (level2 << RNG2_BIT);
+#if defined(TRACE)
+    uint16_t tcnt1 = TCNT1;
+    // Timer1 runs at F_CPU/8 like the sampler
+    TCNT1 += OCR0A + 1;
+    if(TCNT1 < tcnt1 && (TIMSK1 & (1 << TOIE1)))
+        TIMER1_OVF_vect();
+#endif
+    TIMER0_COMPA_vect();
+    samples++;
+}
+
+// The sampler interrupts of one pass through loop(), samples_per_loop at the default sample period
+static void samplePass(){
+    sample_debt += samples_per_loop * (double)SAMPLER_PERIOD / (OCR0A + 1);
+    for(; sample_debt >= 1; sample_debt--)
+        sample();
+}
+
+// A frame that passes while the firmware busy-waits: the sampler keeps interrupting, but loop() does not get to run
+static void stallFrame(){
+    for(uint32_t i=0; i<loops_per_frame; i++)
+        samplePass();
+    frame();
+    stalled++;
+}
+
+// Called whenever the firmware is back in its main loop
+static void resumed(){
+    if(stalled > longest_stall)
+        longest_stall = stalled;
+    stalled = 0;
+}
+
+static void runFrame(){
+    for(uint32_t i=0; i<loops_per_frame; i++){
+        samplePass();
+        if(!EVENT_FLAGS)
+            idle_loops++;
+        loop();
+        loops++;
+        resumed();
+    }
+    frame();
+}
+
+static void startControl(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint16_t length, void *data){
+    uint8_t setup[8] = {
+        type, request, value & 0xFF, value >> 8, index & 0xFF, index >> 8, length & 0xFF, length >> 8,
+    };
+
+    usbmodelControl(setup, data);
+    resumed();
+}
+
+static int16_t control(uint8_t type, uint8_t request, uint16_t value, uint16_t index, uint16_t length, void *data){
+    startControl(type, request, value, index, length, data);
+    // Finish the transfer from the main loop if the firmware does not do it in the interrupt
+    for(uint16_t i=0; i<1000; i++){
+        int16_t status = usbmodelControlStatus();
+        if(status != USBMODEL_CONTROL_Pending)
+            return status;
+        if(turnaround){
+            runFrame();
+        }else{
+            loop();
+            resumed();
+        }
+    }
+    return USBMODEL_CONTROL_Pending;
+}
+
+static void enumerate(){
+    uint8_t descriptor[18];
+
+    usbmodelBusReset();
+    if(control(0x80, REQ_GetDescriptor, DTYPE_Device << 8, 0, sizeof(descriptor), descriptor) != sizeof(descriptor)){
+        fprintf(stderr, "GET_DESCRIPTOR(device) failed\n");
+        exit(1);
+    }
+    if(control(0x00, REQ_SetAddress, 1, 0, 0, NULL) < 0 || control(0x00, REQ_SetConfiguration, 1, 0, 0, NULL) < 0){
+        fprintf(stderr, "SET_ADDRESS/SET_CONFIGURATION failed\n");
+        exit(1);
+    }
+#if !defined(VENDOR_INTERFACE)
+    control(REQDIR_HOSTTODEVICE | REQTYPE_CLASS | REQREC_INTERFACE, CDC_REQ_SetControlLineState, 0x0003, 0, 0, NULL);
+#endif
+}
+
+#if defined(TRACE)
+// Saves one GET_TRACE reply the way usbrng-ctl trace does, and keeps tracing everything but the sampler
+static void dumpTrace(){
+    uint8_t buf[2 + sizeof(trace_dump_t)];
+    uint8_t classes = ~TRACE_CLASS_Sampler;
+    int16_t len = control(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE, VENDOR_REQ_GetTrace, classes, 0,
+                          sizeof(trace_dump_t), buf + 2);
+    if(len < 0){
+        fprintf(stderr, "GET_TRACE failed\n");
+        exit(1);
+    }
+    buf[0] = len;
+    buf[1] = len >> 8;
+    fwrite(buf, 1, len + 2, trace_out);
+}
+#endif
+
+static bool expectation(const char *spec){
+    if(!strncmp(spec, "overruns=", 9)){
+        max_overruns = strtoll(spec + 9, NULL, 0);
+        return true;
+    }
+    if(!strncmp(spec, "throughput=", 11)){
+        min_throughput = strtod(spec + 11, NULL);
+        return true;
+    }
+    if(!strcmp(spec, "health=ok") || !strcmp(spec, "health=fail")){
+        expect_health = !strcmp(spec, "health=fail");
+        return true;
+    }
+    return false;
+}
+
+// Prints every expectation the run missed and returns how many there were
+static int checkExpectations(double throughput){
+    int failed = 0;
+
+    if(max_overruns >= 0 && overruns > (uint64_t)max_overruns){
+        printf("FAIL: %llu sampler overruns, expected at most %lld\n", (unsigned long long)overruns,
+               (long long)max_overruns);
+        failed++;
+    }
+    if(expect_health >= 0 && !health_status != !expect_health){
+        printf("FAIL: health status 0x%02x, expected it %s\n", health_status, expect_health ? "failed" : "clean");
+        failed++;
+    }
+    if(min_throughput >= 0 && throughput < min_throughput){
+        printf("FAIL: %.1f bytes/s, expected at least %.1f\n", throughput, min_throughput);
+        failed++;
+    }
+    return failed;
+}
+
+static double seconds(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *name){
+    fprintf(stderr,
+            "usage: %s [-n frames] [-l loops per frame] [-r samples per loop] [-m mode] [-p period] [-f fold] [-s seed] "
+            "[-1 spec] [-2 spec] [-x p] [-c frames] [-u] [-o file] [-t file] [-e expectation]...\n"
+            "  -n  USB frames (ms) to run, default 1000\n"
+            "  -l  passes through loop() per frame, default 25\n"
+            "  -r  sampler interrupts per pass at the default sample period, default 4\n"
+            "  -m  stream mode to select with SET_MODE, default 0 (noise)\n"
+            "  -p, -f  sample period in ticks of F_CPU/8 and fold factor to select with SET_SAMPLING\n"
+            "  -s  seed of the simulated noise sources\n"
+            "  -1, -2  configure rng1 and rng2: comma separated bias=p, corr=p, rate=edges/s, stuck=level[@s]\n"
+            "      defaults bias=0.5,corr=0,rate=1e6,stuck=-1\n"
+            "  -x  couple the sources: each rng2 sample copies rng1 with probability p\n"
+            "  -c  send GET_COUNTERS (GET_MODE in builds without the counters) every this many frames, with the host only\n"
+            "      moving on with a control transfer once per frame\n"
+            "  -u  leave the CDC notification endpoint unread, as the host does while no tty is open\n"
+            "  -o  write the received stream to file\n"
+            "  -t  with TRACE, trace everything but the sampler and write a dump per frame to file for usbrng-trace\n"
+            "  -e  exit with 1 unless the run meets this: overruns=n (at most n sampler overruns), health=ok or\n"
+            "      health=fail (the health status at the end), throughput=n (at least n bytes/s of simulated time)\n",
+            name);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    uint32_t frames = 1000;
+    uint32_t control_period = 0;
+    int mode = -1;
+    int period = -1;
+    int fold = 1;
+    uint64_t seed = 1;
+    noise_config_t config1 = NOISE_DEFAULTS;
+    noise_config_t config2 = NOISE_DEFAULTS;
+    int opt;
+
+    while((opt = getopt(argc, argv, "n:l:r:m:p:f:s:1:2:x:c:uo:t:e:")) != -1){
+        switch(opt){
+        case 'n': frames = strtoul(optarg, NULL, 0); break;
+        case 'l': loops_per_frame = strtoul(optarg, NULL, 0); break;
+        case 'r': samples_per_loop = strtoul(optarg, NULL, 0); break;
+        case 'm': mode = strtol(optarg, NULL, 0); break;
+        case 'p': period = strtol(optarg, NULL, 0); break;
+        case 'f': fold = strtol(optarg, NULL, 0); break;
+        case 's': seed = strtoull(optarg, NULL, 0); break;
+        case 'x': coupling = strtod(optarg, NULL); break;
+        case 'c': control_period = strtoul(optarg, NULL, 0); break;
+        case 'u': notifications_unread = true; break;
+        case 'e':
+            if(!expectation(optarg)){
+                fprintf(stderr, "bad expectation: %s\n", optarg);
+                return 2;
+            }
+            break;
+        case '1':
+        case '2':
+            if(!noiseParse(opt == '1' ? &config1 : &config2, optarg)){
+                fprintf(stderr, "bad noise source spec: %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'o':
+            out = fopen(optarg, "wb");
+            if(!out){
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 't':
+#if defined(TRACE)
+            trace_out = fopen(optarg, "wb");
+            if(!trace_out){
+                perror(optarg);
+                return 1;
+            }
+            break;
+#else
+            fprintf(stderr, "-t needs a build with OPTS=-DTRACE\n");
+            return 2;
+#endif
+        default: usage(argv[0]);
+        }
+    }
+
+    srand48(seed);
+    noiseInit(&rng1, &config1, seed);
+    noiseInit(&rng2, &config2, seed ^ 0x5DEECE66DULL);
+
+    setup();
+    usbmodelSetHost(stallFrame);
+    enumerate();
+    if(mode >= 0 && control(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE, VENDOR_REQ_SetMode, mode, 0, 0, NULL) < 0){
+        fprintf(stderr, "SET_MODE(%d) stalled\n", mode);
+        return 1;
+    }
+
+    if((period >= 0 || fold != 1) && control(REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE, VENDOR_REQ_SetSampling,
+                                             period >= 0 ? period : SAMPLER_PERIOD, fold, 0, NULL) < 0){
+        fprintf(stderr, "SET_SAMPLING(%d, %d) stalled\n", period, fold);
+        return 1;
+    }
+
+    // Only the run itself counts
+    frames_run = 0;
+    samples = 0;
+    received = 0;
+    packets = 0;
+    overruns = 0;
+    longest_stall = 0;
+    last_overruns = sampler_overruns;
+    double run_start = sampler_time;
+
+    turnaround = control_period;
+    usbmodelSetTurnaround(turnaround);
+#if defined(PERF_COUNTERS)
+    perf_counters_t polled;
+    const uint8_t poll_request = VENDOR_REQ_GetCounters;
+#else
+    stream_mode_info_t polled;
+    const uint8_t poll_request = VENDOR_REQ_GetMode;
+#endif
+    bool polling = false;
+    uint32_t next_poll = 0;
+    uint32_t poll_started = 0;
+    uint32_t polls = 0;
+    uint64_t poll_frames = 0;
+
+    double start = seconds();
+    while(frames_run < frames){
+        if(control_period && !polling && frames_run >= next_poll){
+            poll_started = frames_run;
+            next_poll = frames_run + control_period;
+            polling = true;
+            startControl(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE, poll_request, 0, 0, sizeof(polled),
+                         &polled);
+        }
+        runFrame();
+        if(polling && usbmodelControlStatus() != USBMODEL_CONTROL_Pending){
+            polling = false;
+            polls++;
+            poll_frames += frames_run - poll_started;
+        }
+#if defined(TRACE)
+        if(trace_out && !polling)
+            dumpTrace();
+#endif
+    }
+    double elapsed = seconds() - start;
+    double run_time = sampler_time - run_start;
+
+    turnaround = false;
+    usbmodelSetTurnaround(false);
+
+    if(out)
+        fclose(out);
+    if(trace_out)
+        fclose(trace_out);
+
+    printf("frames:           %u\n", frames_run);
+    printf("loops:            %llu, %llu of them idle\n", (unsigned long long)loops, (unsigned long long)idle_loops);
+    printf("samples:          %llu\n", (unsigned long long)samples);
+    printf("bytes received:   %llu\n", (unsigned long long)received);
+    printf("packets received: %llu\n", (unsigned long long)packets);
+    printf("bits per sample:  %.4f\n", samples ? 8.0 * received / samples : 0.0);
+    printf("sampler overruns: %llu\n", (unsigned long long)overruns);
+    printf("longest stall:    %u frames without loop()\n", longest_stall);
+    if(control_period)
+        printf("control requests: %u, %.2f frames each\n", polls, polls ? (double)poll_frames / polls : 0.0);
+    printf("health failures:  %u\n", health_failures);
+    printf("health status:    0x%02x\n", health_status);
+    printf("simulated time:   %.3f s\n", run_time);
+    double throughput = run_time > 0 ? received / run_time : 0.0;
+    printf("throughput:       %.1f bytes/s\n", throughput);
+    printf("wall time:        %.3f s\n", elapsed);
+    printf("loops per second: %.0f\n", elapsed > 0 ? loops / elapsed : 0.0);
+
+#if defined(PERF_COUNTERS)
+    perf_counters_t c;
+    if(control(REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE, VENDOR_REQ_GetCounters, 0, 0, sizeof(c), &c) != sizeof(c)){
+        fprintf(stderr, "GET_COUNTERS failed\n");
+        return 1;
+    }
+    printf("device counters:  samples %u, extractor %u -> %u bytes, sent %u bytes, %u timeouts, %u overruns, "
+           "%u health failures\n", c.samples, c.extractor_in, c.extractor_out, c.bytes_sent, c.timeouts,
+           c.sampler_overruns, c.health_failures);
+    printf("device frames:    %u, %u short packets\n", c.frames, c.short_packets);
+#endif
+    return checkExpectations(throughput) ? 1 : 0;
+}
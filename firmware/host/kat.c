@@ -0,0 +1,150 @@
+
+#include <stdio.h>
+#include <string.h>
+#include "conditioner.c"
+#include "sponge.c"
+// drbg.c has a 32 bit ROTL of its own
+#undef ROTL
+#undef ROTR
+#include "drbg.c"
+
+/* Known answer tests for the cryptographic code, run by `make check`. The firmware sources are included rather than
+ * linked so the tests can reach their internal state and feed single blocks through the primitives, which the
+ * interfaces used by main.c cannot express.
+ */
+
+RINGBUFFER(output, 64);
+
+static int failures;
+
+static void expect(const char *name, const uint8_t *got, const char *want){
+    char hex[2*64+1];
+    size_t len = strlen(want)/2;
+
+    for(size_t i=0; i<len; i++)
+        sprintf(hex + 2*i, "%02x", got[i]);
+    if(strcmp(hex, want)){
+        printf("%-24s FAIL\n    got  %s\n    want %s\n", name, hex, want);
+        failures++;
+    }else{
+        printf("%-24s ok\n", name);
+    }
+}
+
+#if !defined(SPONGE_CONDITIONER)
+// Hashes a message of up to 55 bytes, which SHA-256 pads into a single block, through one compression
+static void sha256Short(const char *msg, uint8_t out[32]){
+    uint8_t len = strlen(msg);
+
+    conditionerReset();
+    memcpy_P(h, IV, sizeof(h));
+    memset(w, 0, sizeof(w));
+    for(uint8_t i=0; i<len; i++)
+        ((uint8_t *)w)[i ^ 3] = msg[i];
+    ((uint8_t *)w)[len ^ 3] = 0x80;
+    w[15] = len*8UL;
+    startCompression();
+    while(state == COMPRESSING)
+        conditionerStep(&output);
+
+    for(uint8_t i=0; i<32; i++)
+        out[i] = ((uint8_t *)h)[i ^ 3];
+    conditionerReset();
+}
+
+static void testSha256(){
+    uint8_t out[64];
+
+    // FIPS 180-4 examples
+    sha256Short("abc", out);
+    expect("sha256 \"abc\"", out, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    sha256Short("", out);
+    expect("sha256 \"\"", out, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+
+#if CONDITIONER_INPUT_SIZE == 119
+    // A whole output block the way main.c drives the conditioner, padding included
+    conditionerReset();
+    for(uint8_t i=0; i<CONDITIONER_INPUT_SIZE; i++){
+        while(conditionerStep(&output))
+            ;
+        conditionerAbsorb(i*7 + 3);
+    }
+    while(conditionerStep(&output))
+        ;
+    for(uint8_t i=0; i<CONDITIONER_OUTPUT_SIZE; i++)
+        out[i] = ringbufferPop(&output);
+    expect("conditioner block", out, "9ce7368e4daf32341631b492e80359dc9f594b48453cd0dd5bf0b19279cc177e");
+#endif
+}
+#endif
+
+#if defined(SPONGE_CONDITIONER)
+// Runs all rounds of Keccak-f[400] on the pool, a step at a time the way main.c drives it
+static void keccakF400(const uint8_t in[50], uint8_t out[50]){
+    conditionerReset();
+    memcpy(a, in, sizeof(a));
+    rnd = 0;
+    state = PERMUTING;
+    while(state == PERMUTING)
+        conditionerStep(&output);
+    memcpy(out, a, sizeof(a));
+    conditionerReset();
+}
+
+static void testKeccak(){
+    uint8_t in[50], out[50];
+
+    // Lanes little endian, a[x + 5*y] first to last. Checked against a Keccak-f[400] written from the specification.
+    memset(in, 0, sizeof(in));
+    keccakF400(in, out);
+    expect("keccak-f[400] zero", out, "f509ac40a90ff5149fe8a0ecd15b7078f0ef8fbf3703526075dcc90e76e74652a159815d956d"
+                                      "146e3e63ee58ff714c718eb3");
+    for(uint8_t i=0; i<sizeof(in); i++)
+        in[i] = i*7 + 3;
+    keccakF400(in, out);
+    expect("keccak-f[400] pattern", out, "49dd7fbd5c7390952974ef2c1950187dabe1c88673d4bbe4576571fc224febee8b20b89398"
+                                         "907948c1171e1d96d9b8a53bed");
+}
+#endif
+
+static void testChacha20(){
+    uint32_t x[16];
+
+    // RFC 8439 2.3.2. Its nonce has a third word, which block() always leaves at 0, so the state is set up here.
+    uint32_t in[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    for(uint8_t i=0; i<32; i++)
+        ((uint8_t *)&in[4])[i] = i;
+    in[12] = 1;
+    in[13] = 0x09000000;
+    in[14] = 0x4a000000;
+    memcpy(x, in, sizeof(x));
+    rounds(x);
+    for(uint8_t i=0; i<16; i++)
+        x[i] += in[i];
+    expect("chacha20 2.3.2", (uint8_t *)x, "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+                                           "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e");
+
+    // RFC 8439 A.1 test vectors 1 and 3, all zero nonces like the DRBG's, through block() itself
+    memset(key, 0, sizeof(key));
+    block(x, 0, 0);
+    expect("chacha20 A.1 #1", (uint8_t *)x, "76b8e0ada0f13d90405d6ae55386bd28bdd219b8a08ded1aa836efcc8b770dc7"
+                                            "da41597c5157488d7724e03fb8d84a376a43b8f41518a11cc387b669b2ee6586");
+    ((uint8_t *)key)[31] = 1;
+    block(x, 1, 0);
+    expect("chacha20 A.1 #3", (uint8_t *)x, "3aeb5224ecf849929b9d828db1ced4dd832025e8018b8160b82284f3c949aa5a"
+                                            "8eca00bbb4a73bdad192b5c42f73f2fd4e273644c8b36125a64addeb006c13a0");
+    memset(key, 0, sizeof(key));
+}
+
+int main(){
+#if !defined(SPONGE_CONDITIONER)
+    testSha256();
+#else
+    testKeccak();
+#endif
+    testChacha20();
+
+    if(failures)
+        printf("%d known answer tests failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,79 @@
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "noise.h"
+
+// xorshift64*, uniform in (0, 1)
+static double uniform(noise_source_t *src){
+    src->state ^= src->state >> 12;
+    src->state ^= src->state << 25;
+    src->state ^= src->state >> 27;
+    return ((src->state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) + 0x1p-54;
+}
+
+static void scheduleEdge(noise_source_t *src){
+    src->next_event += -log(uniform(src)) / src->config.edge_rate;
+}
+
+void noiseInit(noise_source_t *src, const noise_config_t *config, uint64_t seed){
+    src->config = *config;
+    src->state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    src->level = uniform(src) < config->bias;
+    src->next_event = 0;
+    if(config->edge_rate > 0)
+        scheduleEdge(src);
+}
+
+uint8_t noiseLevel(noise_source_t *src, double t){
+    const noise_config_t *c = &src->config;
+
+    if(c->stuck >= 0 && t >= c->stuck_after)
+        return c->stuck;
+    if(c->edge_rate <= 0)
+        return src->level;
+
+    while(src->next_event <= t){
+        if(uniform(src) >= c->correlation)
+            src->level = uniform(src) < c->bias;
+        scheduleEdge(src);
+    }
+    return src->level;
+}
+
+bool noiseParse(noise_config_t *config, const char *spec){
+    char *copy = strdup(spec);
+    char *save = NULL;
+    bool ok = true;
+
+    for(char *item = strtok_r(copy, ",", &save); item && ok; item = strtok_r(NULL, ",", &save)){
+        char *value = strchr(item, '=');
+        char *end;
+        if(!value){
+            ok = false;
+            break;
+        }
+        *value++ = 0;
+
+        if(!strcmp(item, "bias")){
+            config->bias = strtod(value, &end);
+            ok = !*end && config->bias >= 0 && config->bias <= 1;
+        }else if(!strcmp(item, "corr")){
+            config->correlation = strtod(value, &end);
+            ok = !*end && config->correlation >= 0 && config->correlation <= 1;
+        }else if(!strcmp(item, "rate")){
+            config->edge_rate = strtod(value, &end);
+            ok = !*end && config->edge_rate >= 0;
+        }else if(!strcmp(item, "stuck")){
+            config->stuck = strtol(value, &end, 0);
+            config->stuck_after = 0;
+            if(*end == '@')
+                config->stuck_after = strtod(end+1, &end);
+            ok = !*end && config->stuck >= -1 && config->stuck <= 1;
+        }else{
+            ok = false;
+        }
+    }
+    free(copy);
+    return ok;
+}
@@ -0,0 +1,39 @@
+#ifndef __NOISE_H__
+#define __NOISE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Model of one of the avalanche noise sources (hardware/rng.sch) as seen on its port pin. The comparator output flips
+ * at random instants, a Poisson process at edge_rate. At each such event the new level is the old one with
+ * probability correlation, and otherwise drawn with P(high) = bias. From stuck_after seconds on the output is stuck
+ * at stuck, unless that is negative.
+ */
+typedef struct {
+    double bias;
+    double correlation;
+    double edge_rate;
+    int8_t stuck;
+    double stuck_after;
+} noise_config_t;
+
+typedef struct {
+    noise_config_t config;
+    uint8_t level;
+    double next_event;
+    uint64_t state;
+} noise_source_t;
+
+#define NOISE_DEFAULTS {0.5, 0.0, 1e6, -1, 0.0}
+
+void noiseInit(noise_source_t *src, const noise_config_t *config, uint64_t seed);
+
+// Level of the pin at time t seconds. t must not decrease from one call to the next.
+uint8_t noiseLevel(noise_source_t *src, double t);
+
+/* Parses a comma separated list of bias=, corr=, rate= and stuck=level[@seconds] into config, leaving whatever is not
+ * mentioned alone. Returns false on a malformed spec.
+ */
+bool noiseParse(noise_config_t *config, const char *spec);
+
+#endif//__NOISE_H__
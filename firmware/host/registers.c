@@ -0,0 +1,12 @@
+
+#include <avr/io.h>
+
+volatile uint8_t SREG, MCUSR, MCUCR, SMCR, CLKPR, PRR0, PRR1, GPIOR0, GPIOR1, GPIOR2;
+volatile uint8_t PINB, DDRB, PORTB, PINC, DDRC, PORTC, PIND, DDRD, PORTD;
+volatile uint8_t EICRA, EICRB, EIMSK, EIFR, PCICR, PCIFR, PCMSK0, PCMSK1;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B, OCR1C;
+volatile uint8_t ACSR, DIDR1;
+volatile uint8_t REGCR, USBCON, USBSTA, USBINT, UDCON, UDINT, UDIEN, UDADDR, UDMFN, UENUM, UERST, UEINT, UEBCHX, UESTA1X;
+volatile uint16_t UDFNUM;
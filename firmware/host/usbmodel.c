@@ -0,0 +1,380 @@
+
+#include <string.h>
+#include <avr/io.h>
+#include "usbmodel.h"
+
+#define ENDPOINTS 5
+#define MAX_BANKS 2
+#define MAX_SIZE  64
+
+// Polls of a full IN endpoint that are taken as one frame passing
+#define SPINS_PER_FRAME 16
+
+// Weak, so the model still links if the firmware handles control requests without interrupts
+void USB_GEN_vect(void) __attribute__((weak));
+void USB_COM_vect(void) __attribute__((weak));
+
+typedef struct {
+    usbmodel_endpoint_t regs;
+    uint8_t cfg1;   // UECFG1X as last seen, to spot (re)configuration
+    uint8_t shown;  // UEINTX as last handed to the firmware
+    uint8_t size;
+    uint8_t banks;
+
+    // IN: the first busy banks belong to the host, the one after them is being filled by the firmware
+    uint8_t data[MAX_BANKS][MAX_SIZE];
+    uint8_t len[MAX_BANKS];
+    uint8_t first;
+    uint8_t busy;
+
+    // OUT and control: the packet the firmware is reading
+    uint8_t rx[MAX_SIZE];
+    uint8_t rxlen;
+    uint8_t rxpos;
+    bool setup;
+    bool out;
+} endpoint_t;
+
+enum {
+    STAGE_Idle,
+    STAGE_Setup,
+    STAGE_Data,
+    STAGE_Status,
+    STAGE_Done,
+    STAGE_Stalled,
+};
+
+static endpoint_t endpoints[ENDPOINTS];
+static endpoint_t *touched;
+static volatile uint8_t scratch;
+static volatile uint8_t pllcsr;
+static void (*host)(void);
+static uint8_t spins;
+static bool turnaround;
+
+static struct {
+    uint8_t stage;
+    uint8_t pending; // handshake bits the firmware cleared that the host has not reacted to yet
+    bool in;
+    uint16_t length;
+    uint16_t done;
+    uint8_t *data;
+} control;
+
+static bool isConfigured(const endpoint_t *e){
+    return e->cfg1 & (1 << ALLOC);
+}
+
+static bool isControl(const endpoint_t *e){
+    return !(e->regs.uecfg0x & ((1 << EPTYPE0) | (1 << EPTYPE1)));
+}
+
+static bool isIN(const endpoint_t *e){
+    return e->regs.uecfg0x & (1 << EPDIR);
+}
+
+static uint8_t writeBank(const endpoint_t *e){
+    return (e->first + e->busy) % e->banks;
+}
+
+static void loadOUT(endpoint_t *e, const uint8_t *buf, uint8_t len){
+    if(len)
+        memcpy(e->rx, buf, len);
+    e->rxlen = len;
+    e->rxpos = 0;
+    e->out = true;
+}
+
+// Next chunk of the data stage of a host to device control request
+static void loadControlOUT(endpoint_t *e){
+    uint16_t n = control.length - control.done;
+    if(n > e->size)
+        n = e->size;
+    loadOUT(e, control.data + control.done, n);
+}
+
+static void configure(endpoint_t *e){
+    e->size = 8 << ((e->cfg1 >> EPSIZE0) & 0x07);
+    e->banks = (e->cfg1 & (1 << EPBK0)) ? 2 : 1;
+    e->first = 0;
+    e->busy = 0;
+    memset(e->len, 0, sizeof(e->len));
+    e->rxlen = 0;
+    e->rxpos = 0;
+    e->setup = false;
+    e->out = false;
+}
+
+// What the host does once it sees the handshake bits the firmware cleared on endpoint 0
+static void controlHost(endpoint_t *e){
+    uint8_t cleared = control.pending;
+    control.pending = 0;
+
+    if(cleared & (1 << RXSTPI)){
+        if(control.stage != STAGE_Setup)
+            return;
+        if(control.length && !control.in){
+            control.stage = STAGE_Data;
+            loadControlOUT(e);
+        }else{
+            control.stage = control.length ? STAGE_Data : STAGE_Status;
+        }
+    }
+
+    if(cleared & (1 << RXOUTI)){
+        if(control.stage == STAGE_Data && !control.in){
+            control.done += e->rxlen;
+            if(control.done < control.length)
+                loadControlOUT(e);
+            else
+                control.stage = STAGE_Status;
+        }else if(control.stage == STAGE_Status && control.in){
+            control.stage = STAGE_Done;
+        }
+    }
+
+    if(cleared & (1 << TXINI)){
+        uint8_t len = e->len[0];
+        e->len[0] = 0;
+        if(control.stage == STAGE_Data && control.in){
+            if(len > control.length - control.done)
+                len = control.length - control.done;
+            memcpy(control.data + control.done, e->data[0], len);
+            control.done += len;
+            // The host ends the data stage on a short packet or once it has wLength bytes
+            if(len < e->size || control.done == control.length){
+                control.stage = STAGE_Status;
+                loadOUT(e, NULL, 0);
+            }
+        }else if(control.stage == STAGE_Status && !control.in){
+            control.stage = STAGE_Done;
+        }
+    }
+}
+
+static void controlCleared(endpoint_t *e, uint8_t cleared){
+    if(e->regs.ueconx & (1 << STALLRQ)){
+        e->regs.ueconx &= ~(1 << STALLRQ);
+        if(control.stage != STAGE_Idle)
+            control.stage = STAGE_Stalled;
+    }
+
+    if((cleared & (1 << RXSTPI)) && e->setup){
+        e->setup = false;
+        control.pending |= (1 << RXSTPI);
+    }
+    if((cleared & (1 << RXOUTI)) && e->out){
+        e->out = false;
+        control.pending |= (1 << RXOUTI);
+    }
+    if((cleared & (1 << TXINI)) && !e->setup)
+        control.pending |= (1 << TXINI);
+
+    if(!turnaround)
+        controlHost(e);
+}
+
+// Acts on whatever the firmware wrote to the registers of the endpoint it accessed last
+static void flush(){
+    endpoint_t *e = touched;
+    if(!e)
+        return;
+    touched = NULL;
+
+    if(e->regs.ueconx & (1 << STALLRQC))
+        e->regs.ueconx &= ~((1 << STALLRQC) | (1 << STALLRQ));
+    e->regs.ueconx &= ~(1 << RSTDT);
+
+    if(e->regs.uecfg1x != e->cfg1){
+        e->cfg1 = e->regs.uecfg1x;
+        configure(e);
+    }
+    if(!isConfigured(e))
+        return;
+
+    uint8_t cleared = e->shown & ~e->regs.ueintx;
+    if(isControl(e)){
+        controlCleared(e, cleared);
+    }else if(cleared & (1 << FIFOCON)){
+        if(isIN(e)){
+            // The next bank to fill was emptied when the host took it
+            e->busy++;
+        }else{
+            e->out = false;
+        }
+    }
+}
+
+// Recomputes the status registers of e from the model state
+static void refresh(endpoint_t *e){
+    uint8_t intx = 0;
+    uint8_t sta0x = 0;
+    uint8_t bclx = 0;
+
+    if(isConfigured(e)){
+        sta0x = (1 << CFGOK);
+        if(isControl(e)){
+            if(e->setup)
+                intx = (1 << RXSTPI);
+            else
+                intx = ((control.pending & (1 << TXINI)) ? 0 : (1 << TXINI)) | (e->out ? (1 << RXOUTI) : 0);
+            bclx = (e->setup || e->out) ? e->rxlen - e->rxpos : e->len[0];
+        }else if(isIN(e)){
+            sta0x |= e->busy;
+            if(e->busy < e->banks){
+                bclx = e->len[writeBank(e)];
+                intx = (1 << TXINI) | (1 << FIFOCON) | (bclx < e->size ? (1 << RWAL) : 0);
+            }
+        }else{
+            if(e->out){
+                sta0x |= 1;
+                bclx = e->rxlen - e->rxpos;
+                intx = (1 << RXOUTI) | (1 << FIFOCON) | (bclx ? (1 << RWAL) : 0);
+            }
+        }
+    }
+
+    e->regs.ueintx = intx;
+    e->regs.uesta0x = sta0x;
+    e->regs.uebclx = bclx;
+    e->shown = intx;
+}
+
+usbmodel_endpoint_t *usbmodelEndpoint(){
+    flush();
+    endpoint_t *e = &endpoints[(UENUM & 0x07) % ENDPOINTS];
+    refresh(e);
+
+    bool waiting = isControl(e) ? control.pending : isIN(e) && e->busy == e->banks;
+    if(isConfigured(e) && waiting){
+        if(++spins == SPINS_PER_FRAME && host){
+            spins = 0;
+            host();
+            refresh(e);
+        }
+    }else{
+        spins = 0;
+    }
+
+    touched = e;
+    return &e->regs;
+}
+
+volatile uint8_t *usbmodelUEDATX(){
+    usbmodelEndpoint();
+    endpoint_t *e = touched;
+
+    if(!isConfigured(e))
+        return &scratch;
+
+    if(e->setup || e->out || (!isControl(e) && !isIN(e))){
+        scratch = e->rxpos < e->rxlen ? e->rx[e->rxpos++] : 0;
+        return &scratch;
+    }
+
+    uint8_t bank = isControl(e) ? 0 : writeBank(e);
+    if((!isControl(e) && e->busy == e->banks) || e->len[bank] == e->size)
+        return &scratch;
+    return &e->data[bank][e->len[bank]++];
+}
+
+volatile uint8_t *usbmodelPLLCSR(){
+    // The PLL locks instantly
+    if(pllcsr & (1 << PLLE))
+        pllcsr |= (1 << PLOCK);
+    else
+        pllcsr &= ~(1 << PLOCK);
+    return &pllcsr;
+}
+
+void usbmodelSetHost(void (*frame)(void)){
+    host = frame;
+}
+
+void usbmodelSetTurnaround(bool on){
+    flush();
+    turnaround = on;
+    if(!on && control.pending)
+        controlHost(&endpoints[0]);
+}
+
+void usbmodelBusReset(){
+    flush();
+    UDINT |= (1 << EORSTI);
+    if((UDIEN & (1 << EORSTE)) && USB_GEN_vect)
+        USB_GEN_vect();
+    flush();
+}
+
+void usbmodelStartOfFrame(){
+    flush();
+    UDFNUM = (UDFNUM + 1) & 0x7FF;
+    if(control.pending)
+        controlHost(&endpoints[0]);
+    UDINT |= (1 << SOFI);
+    if((UDIEN & (1 << SOFE)) && USB_GEN_vect)
+        USB_GEN_vect();
+    flush();
+}
+
+void usbmodelControl(const uint8_t setup[8], void *data){
+    flush();
+    endpoint_t *e = &endpoints[0];
+
+    control.stage = STAGE_Setup;
+    control.pending = 0;
+    control.in = setup[0] & 0x80;
+    control.length = setup[6] | (setup[7] << 8);
+    control.done = 0;
+    control.data = data;
+
+    e->len[0] = 0;
+    e->out = false;
+    memcpy(e->rx, setup, 8);
+    e->rxlen = 8;
+    e->rxpos = 0;
+    e->setup = true;
+
+    if((e->regs.ueienx & (1 << RXSTPE)) && USB_COM_vect){
+        uint8_t uenum = UENUM;
+        USB_COM_vect();
+        UENUM = uenum;
+    }
+    flush();
+}
+
+int16_t usbmodelControlStatus(){
+    flush();
+    switch(control.stage){
+    case STAGE_Done:
+        return control.done;
+    case STAGE_Stalled:
+        return USBMODEL_CONTROL_Stalled;
+    default:
+        return USBMODEL_CONTROL_Pending;
+    }
+}
+
+int16_t usbmodelReadIN(uint8_t address, uint8_t *buf){
+    flush();
+    endpoint_t *e = &endpoints[(address & 0x07) % ENDPOINTS];
+    if(!isConfigured(e) || !isIN(e) || !e->busy)
+        return -1;
+
+    uint8_t len = e->len[e->first];
+    memcpy(buf, e->data[e->first], len);
+    e->len[e->first] = 0;
+    e->first = (e->first + 1) % e->banks;
+    e->busy--;
+    return len;
+}
+
+bool usbmodelWriteOUT(uint8_t address, const uint8_t *buf, uint8_t len){
+    flush();
+    endpoint_t *e = &endpoints[(address & 0x07) % ENDPOINTS];
+    if(!isConfigured(e) || isIN(e) || e->out)
+        return false;
+
+    loadOUT(e, buf, len > e->size ? e->size : len);
+    return true;
+}
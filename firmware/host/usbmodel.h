@@ -0,0 +1,68 @@
+#ifndef __USBMODEL_H__
+#define __USBMODEL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Software model of the ATmega16u2 USB device controller, just detailed enough to run the LUFA device stack: endpoint
+ * configuration, the FIFO and handshake bits of UEINTX, control transfers on endpoint 0 and double banked IN and OUT
+ * endpoints. The host side of the bus is driven through the usbmodel* functions below.
+ *
+ * Register writes are not trapped. Instead every access to an endpoint register first looks at what the firmware did
+ * to the registers of the endpoint it touched last and acts on that, e.g. a cleared FIFOCON commits the bank.
+ */
+
+// The registers banked by UENUM, one set per endpoint
+typedef struct {
+    volatile uint8_t ueconx;
+    volatile uint8_t uecfg0x;
+    volatile uint8_t uecfg1x;
+    volatile uint8_t ueienx;
+    volatile uint8_t ueintx;
+    volatile uint8_t uesta0x;
+    volatile uint8_t uebclx;
+} usbmodel_endpoint_t;
+
+// Register access, through the macros in avr/io.h
+usbmodel_endpoint_t *usbmodelEndpoint(void);
+volatile uint8_t *usbmodelUEDATX(void);
+volatile uint8_t *usbmodelPLLCSR(void);
+
+enum {
+    USBMODEL_CONTROL_Pending = -1,
+    USBMODEL_CONTROL_Stalled = -2,
+};
+
+/* The firmware may busy-wait for the host to empty an IN endpoint or to move on with a control transfer. When it has
+ * polled such an endpoint for a while, the model calls back into the harness, which is expected to run one frame of
+ * host activity.
+ */
+void usbmodelSetHost(void (*frame)(void));
+
+/* Off by default: the host reacts to every stage of a control transfer as soon as the firmware is done with the one
+ * before. On: it only does so at the next start of frame, the way a host controller schedules the transactions of a
+ * control transfer no more than once per frame.
+ */
+void usbmodelSetTurnaround(bool on);
+
+// Signals a bus reset to the device
+void usbmodelBusReset(void);
+
+// Starts the next frame: advances the frame number and raises the SOF interrupt
+void usbmodelStartOfFrame(void);
+
+/* Sends a SETUP packet to endpoint 0 and raises the interrupt for it if enabled. data is the buffer for the data
+ * stage, wLength bytes in whichever direction the request specifies.
+ */
+void usbmodelControl(const uint8_t setup[8], void *data);
+
+// USBMODEL_CONTROL_Pending until the status stage is done, then the length of the data stage or _Stalled
+int16_t usbmodelControlStatus(void);
+
+// Takes the oldest packet the device committed on an IN endpoint. Returns its length, or -1 if there is none.
+int16_t usbmodelReadIN(uint8_t address, uint8_t *buf);
+
+// Hands a packet to an OUT endpoint. Returns false if the endpoint still holds the previous one.
+bool usbmodelWriteOUT(uint8_t address, const uint8_t *buf, uint8_t len);
+
+#endif//__USBMODEL_H__
@@ -0,0 +1,14 @@
+#ifndef __HOST_UTIL_ATOMIC_H__
+#define __HOST_UTIL_ATOMIC_H__
+
+#include <stdint.h>
+
+// Interrupts only ever run between two calls into the firmware, so every block is atomic already
+#define ATOMIC_BLOCK(type) for(uint8_t __todo = 1; __todo; __todo = 0)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define NONATOMIC_BLOCK(type) ATOMIC_BLOCK(type)
+#define NONATOMIC_RESTORESTATE
+#define NONATOMIC_FORCEOFF
+
+#endif//__HOST_UTIL_ATOMIC_H__
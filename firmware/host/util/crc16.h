@@ -0,0 +1,14 @@
+#ifndef __HOST_UTIL_CRC16_H__
+#define __HOST_UTIL_CRC16_H__
+
+#include <stdint.h>
+
+// The C equivalent given in the avr-libc documentation of the inline assembly version
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data){
+    crc ^= (uint16_t)data << 8;
+    for(uint8_t i=0; i<8; i++)
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    return crc;
+}
+
+#endif//__HOST_UTIL_CRC16_H__
@@ -0,0 +1,7 @@
+#ifndef __HOST_UTIL_DELAY_H__
+#define __HOST_UTIL_DELAY_H__
+
+#define _delay_us(us) ((void)(us))
+#define _delay_ms(ms) ((void)(ms))
+
+#endif//__HOST_UTIL_DELAY_H__
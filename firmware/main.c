@@ -1,12 +1,22 @@
-
-
 #include <avr/io.h>
 #include <avr/wdt.h>
 #include <avr/power.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
 #include "srsly/USB.h"
 #include "srsly/Descriptors.h"
 #include "main.h"
+#include "ringbuffer.h"
+#include "sampler.h"
+#include "extractor.h"
+#include "health.h"
+#include "conditioner.h"
+#include "drbg.h"
+#include "trace.h"
+#include "events.h"
 
+#if !defined(VENDOR_INTERFACE)
 /** LUFA CDC Class driver interface configuration and state information. This structure is
  *  passed to all CDC Class driver functions, so that multiple instances of the same class
  *  within a device can be differentiated from one another.
@@ -19,13 +29,13 @@ USB_ClassInfo_CDC_Device_t cdcif =
 				.DataINEndpoint           =
 					{
 						.Address          = CDC_TX_EPADDR,
-						.Size             = CDC_TXRX_EPSIZE,
-						.Banks            = 1,
+						.Size             = CDC_TX_EPSIZE,
+						.Banks            = CDC_TX_BANKS,
 					},
 				.DataOUTEndpoint =
 					{
 						.Address          = CDC_RX_EPADDR,
-						.Size             = CDC_TXRX_EPSIZE,
+						.Size             = CDC_RX_EPSIZE,
 						.Banks            = 1,
 					},
 				.NotificationEndpoint =
@@ -36,29 +46,483 @@ USB_ClassInfo_CDC_Device_t cdcif =
 					},
 			},
 	};
+#endif
+
+#define ENTROPY_SIZE 64
+
+RINGBUFFER(entropy, ENTROPY_SIZE);
 
-uint8_t random_data[8];
+/* DRBG and test pattern packets are put together in the storage of the entropy ring, which these modes only use to
+ * collect a DRBG seed. No stack buffer is needed for them, see the SRAM budget in README.md.
+ */
+#define PACKET_BUFFER ((uint32_t *)entropy_data)
+
+static uint8_t stream_mode = STREAM_MODE_Noise;
+static volatile uint8_t requested_mode = STREAM_MODE_Noise;
+// Written by the main loop, read from the control request handler
+static uint32_t mode_since;
+static uint32_t packets_sent;
+#if defined(PERF_COUNTERS)
+static perf_counters_t counters;
+#endif
+
+static uint8_t sample_period_ocr = SAMPLER_PERIOD - 1;
+static uint8_t sample_fold = SAMPLER_FOLD;
+// SET_SAMPLING, the period as its OCR0A value so it is read in one go
+static volatile uint8_t requested_period_ocr = SAMPLER_PERIOD - 1;
+static volatile uint8_t requested_fold = SAMPLER_FOLD;
 
+/* Folds two raw sample bytes into one byte of rng1^rng2 bits. The first byte's four samples end up on the even bits,
+ * the second byte's on the odd bits.
+ */
+static inline uint8_t foldChannels(uint8_t a, uint8_t b){
+    return ((a ^ (a>>1)) & 0x55) | (((b ^ (b>>1)) & 0x55)<<1);
+}
+
+/* Applies a SET_SAMPLING request. The samples taken with the old setting are thrown away together with everything
+ * the pipeline made of them, the same as after a health test failure. The health tests themselves carry on.
+ */
+static void applySampling(){
+    if(sample_period_ocr == requested_period_ocr && sample_fold == requested_fold)
+        return;
+
+    sample_period_ocr = requested_period_ocr;
+    sample_fold = requested_fold;
+    samplerSetPeriod(sample_period_ocr + 1);
+    ringbufferClear(&entropy);
+    extractorReset();
+#if !defined(NO_CONDITIONER)
+    conditionerReset();
+#endif
+}
+
+/* Pops sample_fold raw bytes and returns one byte of four samples per channel in the raw byte format, each sample the
+ * XOR of sample_fold consecutive raw samples.
+ */
+static uint8_t popSamples(){
+    uint8_t fold = sample_fold;
+    if(fold == 1)
+        return ringbufferPop(&raw_samples);
+
+    // Bits per raw byte left after folding: 4 or 2
+    uint8_t bits = 8 >> (fold >> 1);
+    uint8_t out = 0;
+    for(uint8_t i=0; i<fold; i++){
+        uint8_t b = ringbufferPop(&raw_samples);
+        if(fold >= 2){
+            // Pairs of samples into the high nibble
+            b ^= b << 2;
+            b = (b & 0xC0) | ((b << 2) & 0x30);
+        }
+        if(fold == 4){
+            b ^= b << 2;
+            b &= 0xC0;
+        }
+        out = (out << bits) | (b >> (8 - bits));
+    }
+    return out;
+}
+
+/* Runs one pair of raw bytes through the health tests and the extractor and hands the extractor output on. Kept out of
+ * line so that its locals are not on the stack while readBitsAndWhiten() runs the conditioner, the deepest call chain
+ * of the main loop (see the SRAM budget in README.md).
+ */
+static __attribute__((noinline)) void whitenPair(){
+    uint8_t a = popSamples();
+    uint8_t b = popSamples();
+    uint8_t failed = health_status;
+
+#if defined(PERF_COUNTERS)
+    // GET_COUNTERS may be answered from the USB interrupt, which must not find a counter half updated
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        counters.samples += 8 * sample_fold;
+    }
+#endif
+    if(healthTest(a) | healthTest(b)){
+        if(!failed){
+            ringbufferClear(&entropy);
+            extractorReset();
+#if !defined(NO_CONDITIONER)
+            conditionerReset();
+#endif
+            drbgRequireReseed();
+        }
+        return;
+    }
+
+    uint8_t x;
+    bool out = extractorFeed(foldChannels(a, b), &x);
+#if defined(PERF_COUNTERS)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        counters.extractor_in++;
+        counters.extractor_out += out;
+    }
+#endif
+    if(out){
+#if defined(NO_CONDITIONER)
+        ringbufferPush(&entropy, x);
+#else
+        conditionerAbsorb(x);
+#endif
+    }
+}
+
+/* Every raw byte goes through the health tests. While any of them is failing nothing reaches the extractor, and
+ * whatever is still queued in the firmware when the failure is detected is thrown away. Bytes already written to
+ * the stream endpoint are not: a test can only trip some samples after the fault began, so up to two banks of output
+ * from before the failure still go out to the host. Extractor output is hashed by the
+ * conditioner unless the firmware is built with NO_CONDITIONER. While the conditioner is busy compressing, this
+ * returns after one slice of rounds and leaves the raw samples queued for the next pass.
+ */
 void readBitsAndWhiten(){
-    static uint8_t j = 0;
-    for(uint16_t i=0; i<sizeof(random_data); i++){
-        random_data[i] = j;//PORTB&1;
-        //TODO add whitening here
-        j++;
-        //_delay_us(10);
+    applySampling();
+    while(ringbufferFill(&raw_samples) >= 2 * sample_fold){
+#if defined(NO_CONDITIONER)
+        if(!ringbufferSpace(&entropy))
+            break;
+#else
+        if(conditionerStep(&entropy))
+            break;
+#endif
+        whitenPair();
+    }
+}
+
+/* Takes DRBG_SEED_SIZE bytes of conditioned noise from the entropy ring whenever the DRBG is due for a reseed. In
+ * between, and in test pattern mode, the noise is thrown away so the pipeline and with it the health tests keep
+ * running, and the next seed is fresh. In noise mode the DRBG is left alone so it does not eat into the output.
+ *
+ * Outside noise mode this leaves the ring empty unless part of a seed is waiting for the rest, and packets are only
+ * generated into PACKET_BUFFER while it is empty.
+ */
+void reseedDrbg(){
+    if(stream_mode == STREAM_MODE_Noise)
+        return;
+    if(stream_mode != STREAM_MODE_DRBG || !drbgWantsSeed()){
+        ringbufferClear(&entropy);
+        return;
+    }
+    if(ringbufferFill(&entropy) < DRBG_SEED_SIZE)
+        return;
+
+    drbgReseed(&entropy, PACKET_BUFFER);
+    ringbufferClear(&entropy);
+}
+
+static uint8_t health_reported;
+
+/* Tells the host about health test state changes through the CDC notification endpoint: DSR and DCD are asserted
+ * while the noise sources are healthy, a failure drops them and raises a framing error instead. Never waits for the
+ * host: while it has not taken the last notification, e.g. because no tty is open, the change is sent on a later pass.
+ */
+void reportHealth(){
+#if !defined(VENDOR_INTERFACE)
+    if(health_status == health_reported || USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+    Endpoint_SelectEndpoint(CDC_NOTIFICATION_EPADDR);
+    if(!Endpoint_IsINReady())
+        return;
+
+    if(health_status)
+        cdcif.State.ControlLineStates.DeviceToHost = CDC_CONTROL_LINE_IN_FRAMEERROR;
+    else
+        cdcif.State.ControlLineStates.DeviceToHost = CDC_CONTROL_LINE_IN_DSR | CDC_CONTROL_LINE_IN_DCD;
+    CDC_Device_SendControlLineStateChange(&cdcif);
+#endif
+    health_reported = health_status;
+}
+
+#if defined(VENDOR_INTERFACE)
+#define STREAM_EPADDR VENDOR_TX_EPADDR
+#define STREAM_EPSIZE VENDOR_TX_EPSIZE
+#define STREAM_BANKS VENDOR_TX_BANKS
+#else
+#define STREAM_EPADDR CDC_TX_EPADDR
+#define STREAM_EPSIZE CDC_TX_EPSIZE
+#define STREAM_BANKS CDC_TX_BANKS
+#endif
+
+#if ENTROPY_SIZE < DRBG_BLOCK_SIZE
+#error "PACKET_BUFFER needs an entropy ring that holds a whole DRBG block"
+#endif
+#if STREAM_EPSIZE != DRBG_BLOCK_SIZE
+#error "DRBG and test pattern mode expect one DRBG block per packet"
+#endif
+
+// A partially filled packet is sent anyway once it is this many USB frames (ms) old
+#ifndef STREAM_DEADLINE_MS
+#define STREAM_DEADLINE_MS 4
+#endif
+
+/* Noise is committed to the stream endpoint on a plan made at every start of frame: as many full packets as the bank
+ * being filled and the entropy ring hold between them at that point, and otherwise the partial packet once its oldest
+ * byte has waited STREAM_DEADLINE_MS frames. A packet that fills up later in the frame waits for the next one. The
+ * host polls the endpoint after the start of frame, so it finds the frame's packets complete instead of taking a bank
+ * that was committed half full. DRBG and test pattern packets are generated whole and go out as soon as there is a
+ * bank for them.
+ */
+static struct {
+    uint8_t plan;           // full noise packets sendData() may still commit in this frame
+    bool flush;             // commit the partial packet, it is past the deadline
+    uint16_t pending_since; // frame number at which the oldest byte not committed yet was queued
+} schedule;
+
+// Writes to the data IN endpoint of whichever interface the firmware was built with
+static uint8_t streamSendData(const void *buf, uint16_t len){
+#if defined(VENDOR_INTERFACE)
+    Endpoint_SelectEndpoint(VENDOR_TX_EPADDR);
+    return Endpoint_Write_Bank_Stream_LE(buf, len, NULL);
+#else
+    return CDC_Device_SendData(&cdcif, buf, len);
+#endif
+}
+
+#if defined(FRAMED_STREAM)
+#if STREAM_EPSIZE != 64
+#error "The frame layout in main.h assumes 64 byte packets"
+#endif
+#define STREAM_PAYLOAD_SIZE FRAME_MAX_PAYLOAD
+
+static uint16_t frame_crc;
+
+// Sends data as part of the current frame's payload
+static uint8_t framePayload(const uint8_t *p, uint8_t len){
+    for(uint8_t i=0; i<len; i++)
+        frame_crc = _crc_xmodem_update(frame_crc, p[i]);
+    return streamSendData(p, len);
+}
+
+// Starts a frame of len payload bytes, see FRAMED_STREAM in main.h
+static uint8_t frameStart(uint8_t len){
+    uint8_t status = health_status;
+    if(!packets_sent)
+        status |= FRAME_FLAG_Start;
+#if defined(NO_CONDITIONER)
+    status |= FRAME_FLAG_Raw;
+#endif
+    uint8_t header[FRAME_HEADER_SIZE] = { len | (stream_mode << FRAME_MODE_SHIFT), packets_sent, status };
+
+    frame_crc = 0;
+    return framePayload(header, sizeof(header));
+}
+
+static uint8_t frameEnd(){
+    uint8_t crc[FRAME_CRC_SIZE] = { frame_crc, frame_crc >> 8 };
+    return streamSendData(crc, sizeof(crc));
+}
+#else
+#define STREAM_PAYLOAD_SIZE STREAM_EPSIZE
+#endif
+
+/* Fills one test pattern packet, see STREAM_MODE_Pattern in main.h. The sequence number restarts whenever the mode is
+ * entered.
+ */
+static void fillPattern(uint8_t *p, uint16_t now){
+    // Packets go out whole in this mode, so this is the number of the packet being filled
+    uint32_t seq = packets_sent - mode_since;
+
+    p[0] = seq;
+    p[1] = seq >> 8;
+    p[2] = seq >> 16;
+    p[3] = seq >> 24;
+    p[4] = now;
+    p[5] = now >> 8;
+    for(uint8_t i=PATTERN_HEADER_SIZE; i<STREAM_PAYLOAD_SIZE; i++)
+        p[i] = seq + i;
+}
+
+/* Fills PACKET_BUFFER with a whole packet in the modes that do not come out of the entropy ring. Waits while the ring
+ * holds part of a DRBG seed, which is at most until the conditioner's next output. The DRBG gives nothing while a
+ * health test is failing, and after a failure nothing until it has been reseeded.
+ */
+static bool generatePacket(uint16_t now){
+    if(ringbufferFill(&entropy))
+        return false;
+    if(stream_mode == STREAM_MODE_DRBG)
+        return !health_status && drbgGenerate(PACKET_BUFFER);
+    fillPattern((uint8_t *)PACKET_BUFFER, now);
+    return true;
+}
+
+static void commitPacket(){
+    uint8_t len = Endpoint_BytesInEndpoint();
+
+    Endpoint_ClearIN();
+    TRACE_EVENT(TRACE_BankCommit, len);
+    // The other bank may be free, and in noise mode there may be more waiting in the entropy ring
+    eventRaise(EVENT_Stream);
+    if(schedule.plan)
+        schedule.plan--;
+    schedule.flush = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        packets_sent++;
+#if defined(PERF_COUNTERS)
+        counters.bytes_sent += len;
+        if(len < STREAM_EPSIZE)
+            counters.short_packets++;
+#endif
     }
 }
 
+// Runs once per start of frame: counts it and plans the noise commits of the frame, see schedule
+static void planFrame(){
+    if(USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+#if defined(PERF_COUNTERS)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        counters.frames++;
+    }
+#endif
+
+    uint8_t fill = ringbufferFill(&entropy);
+#if defined(FRAMED_STREAM)
+    // Frames are put together from the entropy ring in one go
+    uint8_t partial = fill;
+    uint8_t plan = fill / STREAM_PAYLOAD_SIZE;
+#else
+    // Noise goes into the bank as it comes, unless the host owns all of them
+    Endpoint_SelectEndpoint(STREAM_EPADDR);
+    uint8_t partial = Endpoint_IsINReady() ? Endpoint_BytesInEndpoint() : 0;
+    uint8_t plan = (partial + fill) / STREAM_EPSIZE;
+#endif
+    if(plan > STREAM_BANKS)
+        plan = STREAM_BANKS;
+    schedule.plan = plan;
+    // The USB frame number is 11 bits wide
+    schedule.flush = !plan && partial &&
+        ((USB_Device_GetFrameNumber() - schedule.pending_since) & 0x7FF) >= STREAM_DEADLINE_MS;
+}
+
+// Sends one generated packet, framed if the firmware was built with FRAMED_STREAM
+static uint8_t sendPacket(const uint8_t *p){
+#if defined(FRAMED_STREAM)
+    uint8_t error;
+    if((error = frameStart(STREAM_PAYLOAD_SIZE)) || (error = framePayload(p, STREAM_PAYLOAD_SIZE)))
+        return error;
+    return frameEnd();
+#else
+    return streamSendData(p, STREAM_EPSIZE);
+#endif
+}
+
+/* Copies n bytes from the entropy ring into the current IN bank straight from the ring's storage. n must not exceed
+ * the fill of the ring or the room left in the bank.
+ */
+static uint8_t sendEntropy(uint8_t n){
+    while(n){
+        const uint8_t *p;
+        uint8_t chunk = ringbufferContiguous(&entropy, &p);
+        if(chunk > n)
+            chunk = n;
+
+#if defined(FRAMED_STREAM)
+        uint8_t error = framePayload(p, chunk);
+#else
+        uint8_t error = streamSendData(p, chunk);
+#endif
+        if(error != ENDPOINT_RWSTREAM_NoError)
+            return error;
+
+        ringbufferConsume(&entropy, chunk);
+        n -= chunk;
+    }
+    return ENDPOINT_RWSTREAM_NoError;
+}
+
+/* Copies as much of the entropy ring as fits into the current IN bank and commits what the frame's schedule allows:
+ * full banks while the plan lasts, a partial one when it is due. A full bank beyond the plan stays with the firmware
+ * until the next frame. Never blocks: if both banks are still owned by the host, this returns immediately. In DRBG and
+ * test pattern mode every bank is filled with one whole packet at a time. Mode changes requested by the host are
+ * applied here, while the bank is empty.
+ *
+ * With FRAMED_STREAM the frame header has to go out before the payload, so the noise is held back in the entropy
+ * ring instead of the bank until the plan has a full frame or the oldest byte reaches the deadline.
+ */
 void sendData(){
-    for(uint16_t i=0; i<sizeof(random_data); i++){
-        //CDC_Device_SendByte(&cdcif, random_data[i]);
+    static bool banks_full;
+
+    if(USB_DeviceState != DEVICE_STATE_Configured)
+        return;
+
+    Endpoint_SelectEndpoint(STREAM_EPADDR);
+    if(!Endpoint_IsINReady()){
+        if(!banks_full)
+            TRACE_EVENT(TRACE_BanksFull, 0);
+        banks_full = true;
+        return;
+    }
+    banks_full = false;
+    // A full bank waiting for the plan
+    if(!Endpoint_IsReadWriteAllowed()){
+        if(schedule.plan)
+            commitPacket();
+        return;
     }
-    if(CDC_Device_SendString(&cdcif, "Fnord!\n") == ENDPOINT_RWSTREAM_NoError){
+
+    uint16_t now = USB_Device_GetFrameNumber();
+    uint8_t error = ENDPOINT_RWSTREAM_NoError;
+    if(!Endpoint_BytesInEndpoint()){
+        if(stream_mode != requested_mode){
+            stream_mode = requested_mode;
+            // Noise that was meant for the host is not used as a seed, and PACKET_BUFFER has to be free
+            ringbufferClear(&entropy);
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+                mode_since = packets_sent;
+            }
+        }
+
+        if(stream_mode != STREAM_MODE_Noise){
+            if(!generatePacket(now))
+                return;
+            if(sendPacket((const uint8_t *)PACKET_BUFFER) != ENDPOINT_RWSTREAM_NoError){
+                PORTD &= 0xCF;
+                return;
+            }
+            PORTD |= 0x30;
+            commitPacket();
+            return;
+        }
+
+#if defined(FRAMED_STREAM)
+        uint8_t fill = ringbufferFill(&entropy);
+        if(!fill)
+            schedule.pending_since = now;
+        if(!fill || (fill < STREAM_PAYLOAD_SIZE ? !schedule.flush : !schedule.plan))
+            return;
+        if(fill > STREAM_PAYLOAD_SIZE)
+            fill = STREAM_PAYLOAD_SIZE;
+
+        if((error = frameStart(fill)) || (error = sendEntropy(fill)) || (error = frameEnd())){
+            PORTD &= 0xCF;
+            return;
+        }
         PORTD |= 0x30;
-    }else{
-        PORTD &= 0xCF;
+        commitPacket();
+        schedule.pending_since = now;
+        return;
+#else
+        schedule.pending_since = now;
+#endif
     }
-    CDC_Device_Flush(&cdcif);
+
+#if !defined(FRAMED_STREAM)
+    uint8_t room = STREAM_EPSIZE - Endpoint_BytesInEndpoint();
+    uint8_t fill = ringbufferFill(&entropy);
+    if(fill > room)
+        fill = room;
+    if(fill){
+        if((error = sendEntropy(fill))){
+            PORTD &= 0xCF;
+            return;
+        }
+        PORTD |= 0x30;
+        room -= fill;
+    }
+
+    if(room ? schedule.flush : schedule.plan)
+        commitPacket();
+#endif
 }
 
 void setup(){
@@ -70,24 +534,295 @@ void setup(){
     DDRD |= 0x30;
     PORTD &= 0xCF;
 
+    samplerInit();
+#if defined(TRACE)
+    traceInit();
+#endif
     USB_Init();
+    USB_Device_EnableSOFEvents();
     sei();
 }
 
+#if defined(DEFERRED_CONTROL)
+/* Unless the firmware is built with INTERRUPT_CONTROL_ENDPOINT (see LUFAConfig.h), control requests are picked up from
+ * the main loop by USB_USBTask() instead of USB_COM_vect, and the data stage of a vendor request reply goes out one
+ * packet per pass through controlTask(), so neither an ISR nor the main loop ever waits for the host. Standard and CDC
+ * class requests are still answered in one go, they only come with enumeration and opening the tty.
+ */
+static struct {
+    bool active;
+    bool sending;     // data or a zero length packet left to send
+    bool short_reply; // shorter than wLength, so the host needs a short packet to see the end
+    uint16_t left;
+    const uint8_t *data;
+    void (*done)(void);
+} reply;
+
+static void finishReply(){
+    reply.active = false;
+    if(reply.done)
+        reply.done();
+}
+
+static void controlTask(){
+    if(!reply.active)
+        return;
+
+    Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+    // The host gave up on the transfer and started a new one
+    if(Endpoint_IsSETUPReceived()){
+        finishReply();
+        return;
+    }
+    // Status stage, the host may also cut the data stage short with it
+    if(Endpoint_IsOUTReceived()){
+        Endpoint_ClearOUT();
+        finishReply();
+        return;
+    }
+    if(!reply.sending || !Endpoint_IsINReady())
+        return;
+
+    uint8_t n = reply.left < USB_Device_ControlEndpointSize ? reply.left : USB_Device_ControlEndpointSize;
+    for(uint8_t i=0; i<n; i++)
+        Endpoint_Write_8(*reply.data++);
+    reply.left -= n;
+    Endpoint_ClearIN();
+
+    if(!reply.left && (n < USB_Device_ControlEndpointSize || !reply.short_reply))
+        reply.sending = false;
+}
+
+/* Only flags the SETUP packet for USB_USBTask() in the main loop, which turns the interrupt back on once the request
+ * has been dealt with.
+ */
+ISR(USB_COM_vect){
+    uint8_t ep = Endpoint_GetCurrentEndpoint();
+
+    Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+    USB_INT_Disable(USB_INT_RXSTPI);
+    Endpoint_SelectEndpoint(ep);
+    eventRaise(EVENT_Setup);
+}
+
+void EVENT_USB_Device_Reset(){
+    Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+    USB_INT_Enable(USB_INT_RXSTPI);
+}
+#endif
+
+// The host empties IN banks during a frame, and the stream commits are planned per frame
+void EVENT_USB_Device_StartOfFrame(){
+    eventRaise(EVENT_Frame);
+}
+
+/* Runs the tasks that have an event pending, see events.h. New samples go all the way through the pipeline and on to
+ * the stream endpoint. A deferred control reply is polled on every pass; it only exists while the host is busy with
+ * the transfer, and the sampler wakes the loop every few microseconds anyway.
+ */
 void loop(){
-    readBitsAndWhiten();
-    sendData();
-    CDC_Device_USBTask(&cdcif);
-    USB_USBTask();
+    bool samples = eventTake(EVENT_Samples);
+    bool frame = eventTake(EVENT_Frame);
+
+    if(samples){
+        readBitsAndWhiten();
+        reseedDrbg();
+        reportHealth();
+    }
+    if(frame)
+        planFrame();
+    if(eventTake(EVENT_Stream) | samples | frame){
+        sendData();
+#if !defined(VENDOR_INTERFACE)
+        CDC_Device_USBTask(&cdcif);
+#endif
+    }
+#if defined(DEFERRED_CONTROL)
+    // Before USB_USBTask(), so a reply the host abandoned for a new SETUP is finished first
+    controlTask();
+    if(eventTake(EVENT_Setup)){
+        USB_USBTask();
+        Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+        USB_INT_Enable(USB_INT_RXSTPI);
+    }
+#endif
 }
 
 int main(void){
    setup();
+   set_sleep_mode(SLEEP_MODE_IDLE);
    for(;;){
        loop();
+       /* Idle until the next interrupt unless one has raised an event since loop() looked. Interrupts are only
+        * enabled after the instruction following sei, so none can slip in between the check and sleep_cpu().
+        */
+       cli();
+       if(!EVENT_FLAGS){
+           sleep_enable();
+           sei();
+           sleep_cpu();
+           sleep_disable();
+       }
+       sei();
    }
 }
 
+// Replies built on the fly. They have to outlive processVendorRequest() with DEFERRED_CONTROL, so they are not locals.
+static union {
+    stream_mode_info_t mode;
+    sampling_info_t sampling;
+} reply_data;
+
+/* Sends len bytes as the data stage of the device to host vendor request in USB_ControlRequest and finishes the
+ * transfer. done, if not NULL, runs once the transfer is over. With DEFERRED_CONTROL that is only after this has
+ * returned, and data must stay as it is until then.
+ */
+static void controlReply(const void *data, uint16_t len, void (*done)(void)){
+    Endpoint_ClearSETUP();
+#if defined(DEFERRED_CONTROL)
+    reply.active = true;
+    reply.sending = true;
+    reply.short_reply = len < USB_ControlRequest.wLength;
+    reply.left = reply.short_reply ? len : USB_ControlRequest.wLength;
+    reply.data = data;
+    reply.done = done;
+#else
+    Endpoint_Write_Control_Stream_LE(data, len);
+    Endpoint_ClearOUT();
+    if(done)
+        done();
+#endif
+}
+
+#if defined(TRACE)
+static uint8_t trace_next_classes;
+
+// Starts over once the dump is out, nothing may be traced while it is being sent straight from SRAM
+static void traceDumped(){
+    trace.count = 0;
+    trace.lost = 0;
+    trace_classes = trace_next_classes;
+}
+#endif
+
+// Handles the requests listed in main.h. Returns false for anything else.
+static bool processVendorRequest(){
+    if((USB_ControlRequest.bmRequestType & (CONTROL_REQTYPE_TYPE | CONTROL_REQTYPE_RECIPIENT)) != (REQTYPE_VENDOR | REQREC_DEVICE))
+        return false;
+
+    switch(USB_ControlRequest.bRequest){
+    case VENDOR_REQ_SetMode:
+        if(USB_ControlRequest.bmRequestType != (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+            return false;
+        if(USB_ControlRequest.wValue > STREAM_MODE_Pattern)
+            return false;
+
+        Endpoint_ClearSETUP();
+        requested_mode = USB_ControlRequest.wValue;
+        Endpoint_ClearStatusStage();
+        return true;
+
+    case VENDOR_REQ_GetMode:
+        if(USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+            return false;
+
+        /* This runs from the USB interrupt or, with DEFERRED_CONTROL, between the steps of the main loop, so the main
+         * loop is not in the middle of updating the counters
+         */
+        reply_data.mode.mode = stream_mode;
+        reply_data.mode.since = mode_since;
+        reply_data.mode.packets = packets_sent;
+        controlReply(&reply_data.mode, sizeof(reply_data.mode), NULL);
+        return true;
+
+#if defined(PERF_COUNTERS)
+    case VENDOR_REQ_GetCounters:
+        if(USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+            return false;
+
+        counters.timeouts = Endpoint_Timeouts;
+        counters.sampler_overruns = sampler_overruns;
+        counters.health_failures = health_failures;
+        /* Sent as they are, there is no room for a copy. From the USB interrupt that is a snapshot: the main loop keeps
+         * the counters, it only changes them with interrupts disabled and does not run before the reply is out. With
+         * DEFERRED_CONTROL they keep going while the reply is out, so its packets can be a pass apart.
+         */
+        controlReply(&counters, sizeof(counters), NULL);
+        return true;
+#endif
+
+    case VENDOR_REQ_SetSampling:
+        if(USB_ControlRequest.bmRequestType != (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+            return false;
+        if(USB_ControlRequest.wValue < SAMPLER_MIN_PERIOD || USB_ControlRequest.wValue > 256)
+            return false;
+        if(USB_ControlRequest.wIndex != 1 && USB_ControlRequest.wIndex != 2 && USB_ControlRequest.wIndex != 4)
+            return false;
+
+        Endpoint_ClearSETUP();
+        requested_period_ocr = USB_ControlRequest.wValue - 1;
+        requested_fold = USB_ControlRequest.wIndex;
+        Endpoint_ClearStatusStage();
+        return true;
+
+    case VENDOR_REQ_GetSampling:
+        if(USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+            return false;
+
+        reply_data.sampling.clock_hz = SAMPLER_CLOCK_HZ;
+        reply_data.sampling.period = sample_period_ocr + 1;
+        reply_data.sampling.fold = sample_fold;
+        controlReply(&reply_data.sampling, sizeof(reply_data.sampling), NULL);
+        return true;
+
+#if defined(TRACE)
+    case VENDOR_REQ_GetTrace:
+        if(USB_ControlRequest.bmRequestType != (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+            return false;
+
+        trace_next_classes = USB_ControlRequest.wValue;
+        trace_classes = 0;
+        controlReply(&trace, sizeof(trace), traceDumped);
+        return true;
+#endif
+    }
+    return false;
+}
+
+// The packet count restarts with every configuration
+static void resetStream(){
+    mode_since = 0;
+    packets_sent = 0;
+}
+
+#if defined(VENDOR_INTERFACE)
+void EVENT_USB_Device_ConfigurationChanged(){
+    Endpoint_ConfigureEndpoint(VENDOR_TX_EPADDR, EP_TYPE_BULK, VENDOR_TX_EPSIZE, VENDOR_TX_BANKS);
+    resetStream();
+}
+
+void EVENT_USB_Device_ControlRequest(){
+    processVendorRequest();
+}
+#else
+void EVENT_USB_Device_ConfigurationChanged(){
+    /* What CDC_Device_ConfigureEndpoints() does, without its walk through Endpoint_ConfigureEndpointTable(): that call
+     * chain was the deepest use of the stack in the USB interrupt.
+     */
+    memset(&cdcif.State, 0, sizeof(cdcif.State));
+    Endpoint_ConfigureEndpoint(CDC_TX_EPADDR, EP_TYPE_BULK, CDC_TX_EPSIZE, CDC_TX_BANKS);
+    Endpoint_ConfigureEndpoint(CDC_RX_EPADDR, EP_TYPE_BULK, CDC_RX_EPSIZE, 1);
+    Endpoint_ConfigureEndpoint(CDC_NOTIFICATION_EPADDR, EP_TYPE_INTERRUPT, CDC_NOTIFICATION_EPSIZE, 1);
+    resetStream();
+    // Resend the serial state, configuring the endpoints has reset it
+    health_reported = 0xFF;
+}
+
+void EVENT_USB_Device_ControlRequest(){
+    if(!processVendorRequest())
+        CDC_Device_ProcessControlRequest(&cdcif);
+}
+
 void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo){
     //ignore
 }
@@ -99,3 +834,4 @@ void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const C
 void EVENT_CDC_Device_BreakSent(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo, const uint8_t Duration){
     //ignore
 }
+#endif
@@ -1,9 +1,104 @@
 #ifndef __MAIN_H__
 #define __MAIN_H__
 
+#include <stdint.h>
+
+/* Vendor control requests (bmRequestType vendor, recipient device).
+ * SET_MODE: wValue selects one of the STREAM_MODE_* values. The switch takes effect at the next packet boundary, so
+ *           a packet never mixes output of two modes.
+ * GET_MODE: returns a stream_mode_info_t. Every packet with a sequence number (counted from 0 since the device was
+ *           configured) of at least since was produced by mode.
+ * GET_COUNTERS: returns a perf_counters_t. Stalls in a firmware built without PERF_COUNTERS.
+ * GET_TRACE: returns the trace_dump_t of a firmware built with TRACE (see trace.h) and starts over with an empty ring.
+ *           wValue selects the TRACE_CLASS_* bits to trace from then on. Stalls if the firmware was built without it.
+ * SET_SAMPLING: wValue sets the sample period in ticks of the sampler clock (F_CPU/8), from 10 to 256, wIndex the
+ *           number of consecutive samples of a channel XORed into one, 1, 2 or 4. The main loop applies both and drops
+ *           the raw samples and any output taken with the old setting. Stalls on anything out of range.
+ * GET_SAMPLING: returns a sampling_info_t.
+ */
+enum {
+    VENDOR_REQ_SetMode = 0x01,
+    VENDOR_REQ_GetMode = 0x02,
+    VENDOR_REQ_GetCounters = 0x03,
+    VENDOR_REQ_GetTrace = 0x04,
+    VENDOR_REQ_SetSampling = 0x05,
+    VENDOR_REQ_GetSampling = 0x06,
+};
+
+enum {
+    STREAM_MODE_Noise = 0, // conditioned noise, limited to the rate of the noise sources
+    STREAM_MODE_DRBG  = 1, // ChaCha20 DRBG reseeded from the conditioned noise
+    STREAM_MODE_Pattern = 2, // test pattern at line rate, see below
+};
+
+/* In test pattern mode every 64 byte packet starts with a little endian 32 bit sequence number, counting from 0 when
+ * the mode was entered, and the 16 bit USB frame number at which it was written. Byte i of the rest is
+ * (sequence number + i) & 0xFF. tools/usbrng-verify checks the stream.
+ */
+#define PATTERN_HEADER_SIZE 6
+
+/* Firmware built with FRAMED_STREAM sends every packet as one frame, which survives the packet boundaries getting
+ * lost on the way through a tty:
+ *     byte 0        payload length (bits 0-5) and STREAM_MODE_* (bits 6-7)
+ *     byte 1        sequence number, the low byte of the packet count since the device was configured
+ *     byte 2        health_status (bits 0-4) and FRAME_FLAG_* bits
+ *     payload       up to FRAME_MAX_PAYLOAD bytes. In test pattern mode it holds one pattern packet, shortened to
+ *                   FRAME_MAX_PAYLOAD bytes
+ *     last 2 bytes  CRC-16/XMODEM of everything before it, little endian
+ * tools/usbrng-deframe checks the frames and passes the payload on.
+ */
+#define FRAME_HEADER_SIZE 3
+#define FRAME_CRC_SIZE 2
+#define FRAME_MAX_PAYLOAD (64 - FRAME_HEADER_SIZE - FRAME_CRC_SIZE)
+#define FRAME_LENGTH_MASK 0x3F
+#define FRAME_MODE_SHIFT 6
+#define FRAME_HEALTH_MASK 0x1F
+
+#define FRAME_FLAG_Start 0x20 // first frame since the device was configured, the sequence number restarts at 0
+#define FRAME_FLAG_Raw   0x40 // built with NO_CONDITIONER: noise mode payload is extractor output, not hashed
+
+typedef struct {
+    uint8_t mode;
+    uint32_t since;
+    uint32_t packets;
+} __attribute__((packed)) stream_mode_info_t;
+
+typedef struct {
+    uint32_t clock_hz; // sampler clock, the sample rate is clock_hz / period
+    uint16_t period;
+    uint8_t fold;
+} __attribute__((packed)) sampling_info_t;
+
+/* Whether the firmware keeps the counters below and answers GET_COUNTERS. A TRACE build needs their SRAM for the trace
+ * ring, and so does the deeper stack of one with INTERRUPT_CONTROL_ENDPOINT and the SHA-256 conditioner.
+ */
+#if !defined(TRACE) && (!defined(INTERRUPT_CONTROL_ENDPOINT) || defined(NO_CONDITIONER) || defined(SPONGE_CONDITIONER))
+#define PERF_COUNTERS
+#endif
+
+/* Counted since power up, all of them wrap around except health_failures, which saturates. rng1 and rng2 are sampled
+ * together, so samples holds for both channels. The extractor turns every pair of bytes of folded samples into one
+ * input byte of four bit pairs; 8 * (extractor_in - extractor_out) is the number of bits it discarded. frames ticks at
+ * 1 kHz while the device is configured, so the difference of two readings of bytes_sent over that of frames is the
+ * throughput in bytes per ms as the device sees it.
+ */
+typedef struct {
+    uint32_t samples;         // raw samples per channel the main loop took from the sampler, before folding
+    uint32_t extractor_in;    // bytes fed to the extractor, i.e. folded byte pairs that passed the health tests
+    uint32_t extractor_out;   // bytes the extractor produced
+    uint32_t bytes_sent;      // bytes committed to the stream endpoint, in every mode and including frame headers
+    uint16_t timeouts;        // Endpoint_WaitUntilReady timeouts, on any endpoint
+    uint8_t sampler_overruns; // raw sample bytes dropped because the raw sample ring was full
+    uint8_t health_failures;  // health test failures
+    uint16_t frames;          // USB frames (start of frame packets) seen while configured
+    uint16_t short_packets;   // stream packets committed with less than a full endpoint of data
+} __attribute__((packed)) perf_counters_t;
+
 void setup(void);
 void loop();
 void readBitsAndWhiten();
+void reseedDrbg();
 void sendData();
+void reportHealth();
 
 #endif//__MAIN_H__
@@ -0,0 +1,77 @@
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Single-producer single-consumer byte FIFO. Only the producer writes head and only the consumer writes tail, so an
+ * ISR can feed the main loop (or the other way round) without ever disabling interrupts. Both indices run freely and
+ * are only masked on access, so head-tail is the fill level. For that to be unambiguous the capacity has to be a power
+ * of two no larger than 128.
+ */
+typedef struct {
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    uint8_t mask;
+    uint8_t *data;
+} ringbuffer_t;
+
+/* Defines a ring buffer called name together with its backing storage. */
+#define RINGBUFFER(name, size) \
+    typedef char name##_size_must_be_power_of_two_upto_128[(((size) & ((size)-1)) == 0 && (size) <= 128) ? 1 : -1]; \
+    static uint8_t name##_data[size]; \
+    ringbuffer_t name = {0, 0, (size)-1, name##_data}
+
+/* Keeps the compiler from sinking the data store below the index update that publishes it. */
+#define RINGBUFFER_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+static inline uint8_t ringbufferFill(const ringbuffer_t *rb){
+    return rb->head - rb->tail;
+}
+
+static inline uint8_t ringbufferSpace(const ringbuffer_t *rb){
+    return rb->mask + 1 - (uint8_t)(rb->head - rb->tail);
+}
+
+/* Returns false and drops the byte if the buffer is full. Producer side only. */
+static inline bool ringbufferPush(ringbuffer_t *rb, uint8_t b){
+    uint8_t head = rb->head;
+    if((uint8_t)(head - rb->tail) > rb->mask)
+        return false;
+    rb->data[head & rb->mask] = b;
+    RINGBUFFER_BARRIER();
+    rb->head = head+1;
+    return true;
+}
+
+/* The caller has to make sure the buffer is not empty. Consumer side only. */
+static inline uint8_t ringbufferPop(ringbuffer_t *rb){
+    uint8_t tail = rb->tail;
+    uint8_t b = rb->data[tail & rb->mask];
+    RINGBUFFER_BARRIER();
+    rb->tail = tail+1;
+    return b;
+}
+
+/* Points *p at the oldest byte and returns how many bytes can be read from there without wrapping around, so they
+ * can be handed to a block copy in place. Consumer side only; release them with ringbufferConsume.
+ */
+static inline uint8_t ringbufferContiguous(const ringbuffer_t *rb, const uint8_t **p){
+    uint8_t tail = rb->tail & rb->mask;
+    uint8_t fill = rb->head - rb->tail;
+    uint8_t run = rb->mask + 1 - tail;
+    *p = rb->data + tail;
+    return fill < run ? fill : run;
+}
+
+static inline void ringbufferConsume(ringbuffer_t *rb, uint8_t n){
+    RINGBUFFER_BARRIER();
+    rb->tail += n;
+}
+
+// Drops everything currently buffered. Consumer side only.
+static inline void ringbufferClear(ringbuffer_t *rb){
+    rb->tail = rb->head;
+}
+
+#endif//__RINGBUFFER_H__
@@ -0,0 +1,121 @@
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "sampler.h"
+#include "trace.h"
+#include "events.h"
+
+RINGBUFFER(raw_samples, RAW_SAMPLES_SIZE);
+volatile uint8_t sampler_overruns;
+
+void samplerInit(){
+    RNG_DDR &= ~RNG_MASK;
+    RNG_PORT &= ~RNG_MASK;
+
+    TCCR0A = (1<<WGM01);
+    OCR0A = SAMPLER_PERIOD - 1;
+    TCNT0 = 0;
+    TCCR0B = (1<<CS01);
+    TIMSK0 = (1<<OCIE0A);
+}
+
+void samplerSetPeriod(uint16_t period){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        OCR0A = period - 1;
+        TCNT0 = 0;
+        SAMPLER_PHASE = 0;
+        ringbufferClear(&raw_samples);
+    }
+}
+
+#if defined(__AVR__)
+/* The C version below as a naked handler that saves only what it touches: r24, r25 and SREG, plus Z when a byte is
+ * complete. PIND is read by the second instruction, so the sample is always taken the same number of cycles after
+ * the interrupt is accepted. The three samples that only shift into the accumulator take 26 cycles and the one that
+ * completes a byte 55, whether it is pushed or counted as an overrun, not counting the interrupt response and reti.
+ */
+ISR(TIMER0_COMPA_vect, ISR_NAKED){
+    __asm__ __volatile__(
+        "push r24\n\t"
+        "in   r24, %[pin]\n\t"
+        "push r25\n\t"
+        "in   r25, __SREG__\n\t"
+        "push r25\n\t"
+        "andi r24, %[rng_mask]\n\t"
+        "in   r25, %[acc]\n\t"
+        "lsl  r25\n\t"
+        "lsl  r25\n\t"
+        "or   r25, r24\n\t"
+        "out  %[acc], r25\n\t"
+        "in   r24, %[phase]\n\t"
+        "subi r24, 0x40\n\t"
+        "out  %[phase], r24\n\t"
+        "brne 3f\n\t"
+
+        "push r30\n\t"
+        "push r31\n\t"
+        "lds  r24, %[head]\n\t"
+        "lds  r30, %[tail]\n\t"
+        "mov  r31, r24\n\t"
+        "sub  r31, r30\n\t"
+        "cpi  r31, %[size]\n\t"
+        "brsh 1f\n\t"
+        "mov  r30, r24\n\t"
+        "andi r30, %[size]-1\n\t"
+        "ldi  r31, 0\n\t"
+        "subi r30, lo8(-(%[data]))\n\t"
+        "sbci r31, hi8(-(%[data]))\n\t"
+        "st   Z, r25\n\t"
+        "subi r24, 0xFF\n\t"
+        "sts  %[head], r24\n\t"
+        "rjmp 2f\n"
+        // Full, as long as the other path with the rjmp
+        "1:\n\t"
+        "lds  r24, %[overruns]\n\t"
+        "subi r24, 0xFF\n\t"
+        "sts  %[overruns], r24\n\t"
+        "nop\n\t"
+        "nop\n\t"
+        "nop\n\t"
+        "nop\n\t"
+        "nop\n\t"
+        "nop\n"
+        "2:\n\t"
+        "sbi  %[events], %[event]\n\t"
+        "pop  r31\n\t"
+        "pop  r30\n"
+
+        "3:\n\t"
+        "pop  r25\n\t"
+        "out  __SREG__, r25\n\t"
+        "pop  r25\n\t"
+        "pop  r24\n\t"
+        "reti\n\t"
+        ::
+        [pin] "I" (_SFR_IO_ADDR(RNG_PIN)),
+        [rng_mask] "M" (RNG_MASK),
+        [acc] "I" (_SFR_IO_ADDR(SAMPLER_ACC)),
+        [phase] "I" (_SFR_IO_ADDR(SAMPLER_PHASE)),
+        [head] "i" (&raw_samples.head),
+        [tail] "i" (&raw_samples.tail),
+        [size] "M" (RAW_SAMPLES_SIZE),
+        [data] "i" (raw_samples_data),
+        [overruns] "i" (&sampler_overruns),
+        [events] "I" (_SFR_IO_ADDR(EVENT_FLAGS)),
+        [event] "I" (EVENT_Samples)
+    );
+}
+#else
+// Host builds only, so on the device the sampler is the same with TRACE and its events are never traced
+ISR(TIMER0_COMPA_vect){
+    TRACE_EVENT(TRACE_SamplerEnter, 0);
+    SAMPLER_ACC = (SAMPLER_ACC<<2) | (RNG_PIN & RNG_MASK);
+    if(!(SAMPLER_PHASE -= 0x40)){
+        if(!ringbufferPush(&raw_samples, SAMPLER_ACC))
+            sampler_overruns++;
+        eventRaise(EVENT_Samples);
+    }
+    TRACE_EVENT(TRACE_SamplerExit, 0);
+}
+#endif
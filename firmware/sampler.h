@@ -0,0 +1,61 @@
+#ifndef __SAMPLER_H__
+#define __SAMPLER_H__
+
+#include <stdint.h>
+#include "ringbuffer.h"
+
+// rng1 and rng2 (hardware/usbrng.net, U1 pins 6 and 7)
+#define RNG_PIN     PIND
+#define RNG_DDR     DDRD
+#define RNG_PORT    PORTD
+#define RNG1_BIT    0
+#define RNG2_BIT    1
+#define RNG_MASK    ((1<<RNG1_BIT) | (1<<RNG2_BIT))
+
+#ifndef SAMPLER_RATE_HZ
+#define SAMPLER_RATE_HZ 100000UL
+#endif
+
+/* Timer0 runs at F_CPU/8 in CTC mode and takes a sample every period ticks. VENDOR_REQ_SetSampling (main.h) changes
+ * the period at run time, down to SAMPLER_MIN_PERIOD; with less the sampler ISR would take up most of the CPU.
+ */
+#define SAMPLER_CLOCK_HZ (F_CPU/8)
+#define SAMPLER_PERIOD (SAMPLER_CLOCK_HZ/SAMPLER_RATE_HZ)
+#define SAMPLER_MIN_PERIOD 10
+#if SAMPLER_PERIOD < SAMPLER_MIN_PERIOD || SAMPLER_PERIOD > 256
+#error "SAMPLER_RATE_HZ out of range for Timer0 at F_CPU/8"
+#endif
+
+/* Every SAMPLER_FOLD consecutive samples of a channel are XORed into one before they reach the health tests, which
+ * trades rate for entropy per sample. 1, 2 or 4, also selectable at run time.
+ */
+#ifndef SAMPLER_FOLD
+#define SAMPLER_FOLD 1
+#endif
+#if SAMPLER_FOLD != 1 && SAMPLER_FOLD != 2 && SAMPLER_FOLD != 4
+#error "SAMPLER_FOLD must be 1, 2 or 4"
+#endif
+
+// The raw sample ring covers the longest time the main loop is kept from emptying it, 2.5 ms at the default rate
+#define RAW_SAMPLES_SIZE 64
+
+/* The sampler keeps its state in I/O registers, which in and out reach in a single cycle: the raw sample byte being
+ * assembled, and the phase, which steps down by 0x40 per sample and wraps to 0 when the byte is complete.
+ */
+#define SAMPLER_ACC   GPIOR1
+#define SAMPLER_PHASE GPIOR2
+
+/* Raw samples as produced by the sampler ISR. Every byte holds four consecutive samples, oldest in the top two bits,
+ * each sample being (rng2<<1 | rng1).
+ */
+extern ringbuffer_t raw_samples;
+// Number of raw bytes dropped because the main loop did not keep up
+extern volatile uint8_t sampler_overruns;
+
+void samplerInit(void);
+/* Changes the sample period and starts the raw samples over, so no raw byte holds samples taken at both rates. Main
+ * loop only.
+ */
+void samplerSetPeriod(uint16_t period);
+
+#endif//__SAMPLER_H__
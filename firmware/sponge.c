@@ -0,0 +1,148 @@
+
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "conditioner.h"
+
+#if defined(SPONGE_CONDITIONER)
+
+#if SPONGE_ROUNDS % SPONGE_ROUNDS_PER_STEP
+#error "SPONGE_ROUNDS_PER_STEP must divide 20"
+#endif
+#if SPONGE_RATIO < 1 || SPONGE_RATIO > 8
+#error "SPONGE_RATIO must be between 1 and 8"
+#endif
+
+// The low 16 bits of the Keccak round constants
+static const uint16_t PROGMEM RC[SPONGE_ROUNDS] = {
+    0x0001, 0x8082, 0x808a, 0x8000, 0x808b, 0x0001, 0x8081, 0x8009, 0x008a, 0x0088,
+    0x8009, 0x000a, 0x808b, 0x008b, 0x8089, 0x8003, 0x8002, 0x0080, 0x800a, 0x000a,
+};
+
+enum {
+    IDLE,
+    PERMUTING,
+};
+
+static uint16_t a[25];      // the pool, lane (x, y) at a[x + 5*y]
+static uint8_t pos;         // next rate byte to absorb into
+static uint8_t absorbed;    // input bytes since the last output, saturating
+static uint8_t rnd;         // next round of the permutation in progress
+static uint8_t state;
+
+#define ROTL(x, n) ((uint16_t)((x) << (n)) | (uint16_t)((x) >> (16-(n))))
+#define ROTR(x, n) ((uint16_t)((x) >> (n)) | (uint16_t)((x) << (16-(n))))
+
+// A rotation by 8 is a register swap, so every rotation is reduced to at most that and a rotation by up to four bits
+static inline uint16_t rol(uint16_t x, uint8_t n){
+    if(n > 12)
+        return ROTR(x, 16-n);
+    if(n >= 8)
+        return n == 8 ? ROTL(x, 8) : ROTL(ROTL(x, 8), n-8);
+    if(n > 4)
+        return ROTR(ROTL(x, 8), 8-n);
+    return ROTL(x, n);
+}
+
+/* Everything is unrolled with constant lane indices, so every lane access is a single lds/sts pair and the rotations
+ * inline to register moves and a few rol/ror.
+ */
+#define COLUMN(x) (a[x] ^ a[(x)+5] ^ a[(x)+10] ^ a[(x)+15] ^ a[(x)+20])
+
+#define THETA(x) do { \
+        uint16_t d = c[((x)+4) % 5] ^ rol(c[((x)+1) % 5], 1); \
+        a[x] ^= d; a[(x)+5] ^= d; a[(x)+10] ^= d; a[(x)+15] ^= d; a[(x)+20] ^= d; \
+    } while(0)
+
+// rho and pi together, walking the cycle of pi with one lane in flight
+#define RHOPI(i, n) do { \
+        uint16_t u = a[i]; \
+        a[i] = rol(t, n); \
+        t = u; \
+    } while(0)
+
+#define CHI(y) do { \
+        uint16_t b0 = a[(y)], b1 = a[(y)+1], b2 = a[(y)+2], b3 = a[(y)+3], b4 = a[(y)+4]; \
+        a[(y)]   = b0 ^ (~b1 & b2); \
+        a[(y)+1] = b1 ^ (~b2 & b3); \
+        a[(y)+2] = b2 ^ (~b3 & b4); \
+        a[(y)+3] = b3 ^ (~b4 & b0); \
+        a[(y)+4] = b4 ^ (~b0 & b1); \
+    } while(0)
+
+static void permute(uint8_t rounds){
+    uint8_t r = rnd;
+
+    do{
+        uint16_t c[5] = { COLUMN(0), COLUMN(1), COLUMN(2), COLUMN(3), COLUMN(4) };
+        THETA(0); THETA(1); THETA(2); THETA(3); THETA(4);
+
+        uint16_t t = a[1];
+        RHOPI(10, 1);  RHOPI(7, 3);   RHOPI(11, 6);  RHOPI(17, 10); RHOPI(18, 15); RHOPI(3, 5);
+        RHOPI(5, 12);  RHOPI(16, 4);  RHOPI(8, 13);  RHOPI(21, 7);  RHOPI(24, 2);  RHOPI(4, 14);
+        RHOPI(15, 11); RHOPI(23, 9);  RHOPI(19, 8);  RHOPI(13, 8);  RHOPI(12, 9);  RHOPI(2, 11);
+        RHOPI(20, 14); RHOPI(14, 2);  RHOPI(22, 7);  RHOPI(9, 13);  RHOPI(6, 4);   RHOPI(1, 12);
+
+        CHI(0); CHI(5); CHI(10); CHI(15); CHI(20);
+
+        a[0] ^= pgm_read_word(&RC[r]);
+        r++;
+    }while(--rounds);
+
+    rnd = r;
+}
+
+// Pads the input since the last permutation with pad10*1 and starts the next permutation
+static void startPermutation(){
+    uint8_t *rate = (uint8_t *)a;
+
+    rate[pos] ^= 0x01;
+    rate[SPONGE_RATE-1] ^= 0x80;
+    pos = 0;
+    rnd = 0;
+    state = PERMUTING;
+}
+
+void conditionerReset(){
+    memset(a, 0, sizeof(a));
+    pos = 0;
+    absorbed = 0;
+    state = IDLE;
+}
+
+void conditionerAbsorb(uint8_t b){
+    // Keccak lanes are little endian, the same as the AVR
+    ((uint8_t *)a)[pos++] ^= b;
+    if(absorbed != 0xFF)
+        absorbed++;
+    if(pos == SPONGE_RATE-1)
+        startPermutation();
+}
+
+bool conditionerStep(ringbuffer_t *out){
+    if(state == PERMUTING){
+        permute(SPONGE_ROUNDS_PER_STEP);
+        if(rnd == SPONGE_ROUNDS)
+            state = IDLE;
+        return true;
+    }
+
+    if(absorbed < SPONGE_INPUT_SIZE || ringbufferSpace(out) < CONDITIONER_OUTPUT_SIZE)
+        return false;
+
+    // Output only ever comes straight out of a permutation, never with input XORed in since
+    if(pos){
+        startPermutation();
+        return true;
+    }
+
+    // Squeezed lanes are zeroed, so a later look at the pool cannot be run back to output that has already left
+    uint8_t *rate = (uint8_t *)a;
+    for(uint8_t i=0; i<CONDITIONER_OUTPUT_SIZE; i++){
+        ringbufferPush(out, rate[i]);
+        rate[i] = 0;
+    }
+    absorbed = 0;
+    return false;
+}
+
+#endif
@@ -28,6 +28,30 @@
 #include <avr/pgmspace.h>
 #include "USB.h"
 
+/** Size in bytes of the endpoint DPRAM of the ATmega8u2/16u2/32u2, shared by all endpoint banks. */
+#define USB_DPRAM_SIZE                 176
+
+/* Building with VENDOR_INTERFACE replaces the CDC-ACM interface pair with a single vendor specific interface that
+ * only has a bulk IN endpoint, for hosts that read the entropy stream through libusb or a dedicated driver instead
+ * of the tty layer. The DPRAM does not have room for both at full size, so it is either/or.
+ */
+#if defined(VENDOR_INTERFACE)
+
+/** Endpoint address of the vendor interface's device-to-host bulk IN endpoint. */
+#define VENDOR_TX_EPADDR               (ENDPOINT_DIR_IN  | 1)
+
+/** Size in bytes of the vendor interface's bulk IN endpoint. */
+#define VENDOR_TX_EPSIZE               64
+
+/** Number of hardware banks of the vendor interface's bulk IN endpoint. */
+#define VENDOR_TX_BANKS                2
+
+#if (ENDPOINT_CONTROLEP_DEFAULT_SIZE + VENDOR_TX_BANKS * VENDOR_TX_EPSIZE) > USB_DPRAM_SIZE
+#error "Endpoint banks do not fit into the USB controller's DPRAM"
+#endif
+
+#else
+
 /** Endpoint address of the CDC device-to-host notification IN endpoint. */
 #define CDC_NOTIFICATION_EPADDR        (ENDPOINT_DIR_IN  | 2)
 
@@ -37,11 +61,29 @@
 /** Endpoint address of the CDC host-to-device data OUT endpoint. */
 #define CDC_RX_EPADDR                  (ENDPOINT_DIR_OUT | 4)
 
-/** Size in bytes of the CDC device-to-host notification IN endpoint. */
-#define CDC_NOTIFICATION_EPSIZE        8
+/** Size in bytes of the CDC device-to-host notification IN endpoint. A serial state notification is 10 bytes, it has
+ *  to fit into one packet so that sending it never waits for the host.
+ */
+#define CDC_NOTIFICATION_EPSIZE        16
 
-/** Size in bytes of the CDC data IN and OUT endpoints. */
-#define CDC_TXRX_EPSIZE                16
+/** Size in bytes of the CDC data IN endpoint. This carries the entropy stream, so it runs at the full-speed bulk
+ *  maximum.
+ */
+#define CDC_TX_EPSIZE                  64
+
+/** Number of hardware banks of the CDC data IN endpoint. With two banks the firmware can fill one while the host
+ *  drains the other.
+ */
+#define CDC_TX_BANKS                   2
+
+/** Size in bytes of the CDC data OUT endpoint. Nothing of interest is ever received, so this is kept small. */
+#define CDC_RX_EPSIZE                  16
+
+#if (ENDPOINT_CONTROLEP_DEFAULT_SIZE + CDC_NOTIFICATION_EPSIZE + CDC_TX_BANKS * CDC_TX_EPSIZE + CDC_RX_EPSIZE) > USB_DPRAM_SIZE
+#error "Endpoint banks do not fit into the USB controller's DPRAM"
+#endif
+
+#endif
 
 /** Type define for the device configuration descriptor structure. This must be defined in the
  *  application code, as the configuration descriptor contains several sub-descriptors which
@@ -51,6 +93,11 @@ typedef struct
 {
     USB_Descriptor_Configuration_Header_t    Config;
 
+#if defined(VENDOR_INTERFACE)
+    // Vendor Interface
+    USB_Descriptor_Interface_t               Vendor_Interface;
+    USB_Descriptor_Endpoint_t                Vendor_DataInEndpoint;
+#else
     // CDC Control Interface
     USB_Descriptor_Interface_t               CDC_CCI_Interface;
     USB_CDC_Descriptor_FunctionalHeader_t    CDC_Functional_Header;
@@ -62,6 +109,7 @@ typedef struct
     USB_Descriptor_Interface_t               CDC_DCI_Interface;
     USB_Descriptor_Endpoint_t                CDC_DataOutEndpoint;
     USB_Descriptor_Endpoint_t                CDC_DataInEndpoint;
+#endif
 } USB_Descriptor_Configuration_t;
 
 uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
@@ -25,6 +25,7 @@
 #include "Common.h"
 #include "USBMode.h"
 #include "Endpoint.h"
+#include "../trace.h"
 
 #if !defined(FIXED_CONTROL_ENDPOINT_SIZE)
 uint8_t USB_Device_ControlEndpointSize = ENDPOINT_CONTROLEP_DEFAULT_SIZE;
@@ -139,7 +140,24 @@ void Endpoint_ClearStatusStage(void)
 }
 
 #if !defined(CONTROL_ONLY_DEVICE)
+// Only read by GET_COUNTERS, see PERF_COUNTERS in main.h
+uint16_t Endpoint_Timeouts;
+
+#if defined(TRACE)
+static uint8_t WaitUntilReady(void);
+
+uint8_t Endpoint_WaitUntilReady(void)
+{
+	TRACE_EVENT(TRACE_WaitEnter, Endpoint_GetCurrentEndpoint());
+	uint8_t ErrorCode = WaitUntilReady();
+	TRACE_EVENT(TRACE_WaitExit, ErrorCode);
+	return ErrorCode;
+}
+
+static uint8_t WaitUntilReady(void)
+#else
 uint8_t Endpoint_WaitUntilReady(void)
+#endif
 {
 	#if (USB_STREAM_TIMEOUT_MS < 0xFF)
 	uint8_t  TimeoutMSRem = USB_STREAM_TIMEOUT_MS;
@@ -178,7 +196,10 @@ uint8_t Endpoint_WaitUntilReady(void)
 			PreviousFrameNumber = CurrentFrameNumber;
 
 			if (!(TimeoutMSRem--))
-			  return ENDPOINT_READYWAIT_Timeout;
+			{
+				Endpoint_Timeouts++;
+				return ENDPOINT_READYWAIT_Timeout;
+			}
 		}
 	}
 }
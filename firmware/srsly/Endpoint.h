@@ -761,4 +761,10 @@ void Endpoint_ClearStatusStage(void);
  */
 uint8_t Endpoint_WaitUntilReady(void);
 
+/** Number of times \ref Endpoint_WaitUntilReady() gave up with \ref ENDPOINT_READYWAIT_Timeout, wrapping around.
+ *
+ *  \ingroup Group_EndpointRW_AVR8
+ */
+extern uint16_t Endpoint_Timeouts;
+
 #endif
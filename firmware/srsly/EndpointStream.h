@@ -233,6 +233,24 @@ uint8_t Endpoint_Write_Stream_LE(const void* const Buffer,
                                  uint16_t Length,
                                  uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1);
 
+/** Bank-at-a-time version of \ref Endpoint_Write_Stream_LE(). Instead of checking the endpoint's FIFO
+ *  status before every byte, this works out how much room is left in the current bank and then copies
+ *  that many bytes into the bank with an unrolled loop. Behaviour and return values are otherwise
+ *  identical to \ref Endpoint_Write_Stream_LE().
+ *
+ *  \note This routine should not be used on CONTROL type endpoints.
+ *
+ *  \param[in] Buffer          Pointer to the source data buffer to read from.
+ *  \param[in] Length          Number of bytes to read for the currently selected endpoint into the buffer.
+ *  \param[in] BytesProcessed  Pointer to a location where the total number of bytes processed in the current
+ *                             transaction should be updated, \c NULL if the entire stream should be written at once.
+ *
+ *  \return A value from the \ref Endpoint_Stream_RW_ErrorCodes_t enum.
+ */
+uint8_t Endpoint_Write_Bank_Stream_LE(const void* const Buffer,
+                                      uint16_t Length,
+                                      uint16_t* const BytesProcessed) ATTR_NON_NULL_PTR_ARG(1);
+
 /** Writes the given number of bytes to the endpoint from the given buffer in big endian,
  *  sending full packets to the host as needed. The last packet filled is not automatically sent;
  *  the user is responsible for manually sending the last written packet to the host via the
@@ -35,7 +35,8 @@
 //		#define HID_MAX_COLLECTIONS              {Insert Value Here}
 //		#define HID_MAX_REPORTITEMS              {Insert Value Here}
 //		#define HID_MAX_REPORT_IDS               {Insert Value Here}
-//		#define NO_CLASS_DRIVER_AUTOFLUSH
+		#define NO_CLASS_DRIVER_AUTOFLUSH
+		#define NO_CDC_LINE_ENCODING_CHECK
 
 		/* General USB Driver Related Tokens: */
 //		#define ORDERED_EP_CONFIG
@@ -55,7 +56,11 @@
 //		#define DEVICE_STATE_AS_GPIOR            {Insert Value Here}
 		#define FIXED_NUM_CONFIGURATIONS         1
 //		#define CONTROL_ONLY_DEVICE
-		#define INTERRUPT_CONTROL_ENDPOINT
+		/* The firmware answers control requests from its main loop, see DEFERRED_CONTROL in main.c, unless it is
+		 * built with INTERRUPT_CONTROL_ENDPOINT. */
+		#if !defined(INTERRUPT_CONTROL_ENDPOINT)
+		#define DEFERRED_CONTROL
+		#endif
 //		#define NO_DEVICE_REMOTE_WAKEUP
 //		#define NO_DEVICE_SELF_POWER
 
@@ -24,6 +24,7 @@
 
 #include "Common.h"
 #include "USBInterrupt.h"
+#include "../trace.h"
 
 void USB_INT_DisableAllInterrupts(void)
 {
@@ -47,6 +48,8 @@ void USB_INT_ClearAllInterrupts(void)
 
 ISR(USB_GEN_vect, ISR_BLOCK)
 {
+	TRACE_EVENT(TRACE_USBGenEnter, 0);
+
 	#if !defined(NO_SOF_EVENTS)
 	if (USB_INT_HasOccurred(USB_INT_SOFI) && USB_INT_IsEnabled(USB_INT_SOFI))
 	{
@@ -149,11 +152,15 @@ ISR(USB_GEN_vect, ISR_BLOCK)
 
 		EVENT_USB_Device_Reset();
 	}
+
+	TRACE_EVENT(TRACE_USBGenExit, 0);
 }
 
 #if defined(INTERRUPT_CONTROL_ENDPOINT)
 ISR(USB_COM_vect, ISR_BLOCK)
 {
+	TRACE_EVENT(TRACE_ControlEnter, 0);
+
 	uint8_t PrevSelectedEndpoint = Endpoint_GetCurrentEndpoint();
 
 	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
@@ -166,5 +173,7 @@ ISR(USB_COM_vect, ISR_BLOCK)
 	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
 	USB_INT_Enable(USB_INT_RXSTPI);
 	Endpoint_SelectEndpoint(PrevSelectedEndpoint);
+
+	TRACE_EVENT(TRACE_ControlExit, USB_ControlRequest.bRequest);
 }
 #endif
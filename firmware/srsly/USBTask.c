@@ -23,6 +23,7 @@
 */
 
 #include "USBTask.h"
+#include "../trace.h"
 
 volatile bool        USB_IsInitialized;
 USB_Request_Header_t USB_ControlRequest;
@@ -45,7 +46,11 @@ void USB_DeviceTask(void)
 		Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
 
 		if (Endpoint_IsSETUPReceived())
-		  USB_Device_ProcessControlRequest();
+		{
+			TRACE_EVENT(TRACE_ControlEnter, 0);
+			USB_Device_ProcessControlRequest();
+			TRACE_EVENT(TRACE_ControlExit, USB_ControlRequest.bRequest);
+		}
 
 		Endpoint_SelectEndpoint(PrevEndpoint);
 	}
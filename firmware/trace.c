@@ -0,0 +1,47 @@
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "trace.h"
+
+#if defined(TRACE)
+
+#if TRACE_SIZE > 255
+#error "TRACE_SIZE must fit the 8 bit indices"
+#endif
+
+trace_dump_t trace;
+volatile uint8_t trace_classes;
+
+void traceInit(){
+    TCCR1A = 0;
+    TCNT1 = 0;
+    TCCR1B = (1<<CS11);
+    TIMSK1 = (1<<TOIE1);
+}
+
+void traceEvent(uint8_t event, uint8_t arg){
+    uint8_t classes = trace_classes;
+    if(event == TRACE_Overflow ? !classes : !(classes & TRACE_CLASS(event)))
+        return;
+
+    // Interrupts are off so that nothing else is traced between reading the time and storing the entry
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        trace_entry_t *e = &trace.entries[trace.head];
+        e->time = TCNT1;
+        e->event = event;
+        e->arg = arg;
+        if(++trace.head == TRACE_SIZE)
+            trace.head = 0;
+        if(trace.count < TRACE_SIZE)
+            trace.count++;
+        else if(trace.lost < 0xFF)
+            trace.lost++;
+    }
+}
+
+ISR(TIMER1_OVF_vect){
+    TRACE_EVENT(TRACE_Overflow, 0);
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+
+/* Event trace for latency profiling, compiled in with TRACE. Every event goes into a ring in SRAM together with the
+ * Timer1 count at which it happened. Timer1 runs freely at F_CPU/8, i.e. 0.5us per tick at 16MHz, and every overflow
+ * is traced as well so the host can tell how many times the count wrapped. VENDOR_REQ_GetTrace (main.h) dumps the
+ * ring. Nothing is traced until the host enables some of the TRACE_CLASS_* bits with it.
+ *
+ * The high nibble of an event is its class, the low nibble tells events of a class apart.
+ */
+
+#define TRACE_CLASS(event) (1 << ((event) >> 4))
+
+#define TRACE_CLASS_Sampler 0x02
+#define TRACE_CLASS_USBGen  0x04
+#define TRACE_CLASS_Control 0x08
+#define TRACE_CLASS_Bank    0x10
+#define TRACE_CLASS_Wait    0x20
+
+enum {
+    TRACE_Overflow      = 0x00, // Timer1 wrapped, traced whenever any of the classes is enabled
+    TRACE_SamplerEnter  = 0x10, // host builds only, see sampler.c
+    TRACE_SamplerExit   = 0x11,
+    TRACE_USBGenEnter   = 0x20,
+    TRACE_USBGenExit    = 0x21,
+    TRACE_ControlEnter  = 0x30, // USB_COM_vect, or USB_USBTask with DEFERRED_CONTROL
+    TRACE_ControlExit   = 0x31, // arg: bRequest of the request that was handled
+    TRACE_BankCommit    = 0x40, // a stream IN bank was handed to the host, arg: its length
+    TRACE_BanksFull     = 0x41, // the stream endpoint ran out of free banks
+    TRACE_WaitEnter     = 0x50, // Endpoint_WaitUntilReady, arg: endpoint number
+    TRACE_WaitExit      = 0x51, // arg: ENDPOINT_READYWAIT_* result
+};
+
+/* Entries in the ring. Every one takes four bytes of SRAM, which is about used up without the trace: the ring only fits
+ * in place of the conditioner and the performance counters (main.h).
+ */
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 32
+#endif
+
+#if defined(TRACE) && !defined(NO_CONDITIONER)
+#error "TRACE needs NO_CONDITIONER to make room for the trace ring"
+#endif
+
+typedef struct {
+    uint8_t event;
+    uint8_t arg;
+    uint16_t time;
+} __attribute__((packed)) trace_entry_t;
+
+/* What VENDOR_REQ_GetTrace returns. The valid entries end just before entries[head]: the oldest is
+ * entries[(head - count) % TRACE_SIZE]. lost counts events that were overwritten before they could be dumped,
+ * saturating.
+ */
+typedef struct {
+    uint8_t head;
+    uint8_t count;
+    uint8_t lost;
+    trace_entry_t entries[TRACE_SIZE];
+} __attribute__((packed)) trace_dump_t;
+
+#if defined(TRACE)
+#define TRACE_EVENT(event, arg) traceEvent(event, arg)
+
+extern trace_dump_t trace;
+extern volatile uint8_t trace_classes;
+
+void traceInit(void);
+void traceEvent(uint8_t event, uint8_t arg);
+#else
+// sizeof keeps arg, which may only be there for the trace, from counting as unused without evaluating it
+#define TRACE_EVENT(event, arg) do{ (void)sizeof(arg); }while(0)
+#endif
+
+#endif//__TRACE_H__
@@ -0,0 +1,232 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libusb.h>
+#include "../firmware/main.h"
+#include "../firmware/trace.h"
+
+/* Talks to the vendor control requests of the firmware, see firmware/main.h. Works with both the CDC and the
+ * VENDOR_INTERFACE build, control requests to the device do not need the interface to be claimed.
+ */
+
+#define USBRNG_VID     0x03EB
+#define USBRNG_PID_CDC 0x2044
+#define USBRNG_PID_VENDOR 0x2040
+#define TIMEOUT_MS 1000
+
+static const char *mode_names[] = {
+    [STREAM_MODE_Noise]   = "noise",
+    [STREAM_MODE_DRBG]    = "drbg",
+    [STREAM_MODE_Pattern] = "pattern",
+};
+#define MODE_COUNT (sizeof(mode_names) / sizeof(mode_names[0]))
+
+static libusb_device_handle *openDevice(){
+    libusb_device_handle *dev = libusb_open_device_with_vid_pid(NULL, USBRNG_VID, USBRNG_PID_CDC);
+    if(!dev)
+        dev = libusb_open_device_with_vid_pid(NULL, USBRNG_VID, USBRNG_PID_VENDOR);
+    if(!dev){
+        fprintf(stderr, "no usbrng found\n");
+        exit(1);
+    }
+    return dev;
+}
+
+static int vendorOut(libusb_device_handle *dev, uint8_t request, uint16_t value, uint16_t index){
+    return libusb_control_transfer(dev, LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
+                                   request, value, index, NULL, 0, TIMEOUT_MS);
+}
+
+static int vendorIn(libusb_device_handle *dev, uint8_t request, uint16_t value, void *buf, uint16_t len){
+    return libusb_control_transfer(dev, LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
+                                   request, value, 0, buf, len, TIMEOUT_MS);
+}
+
+static int getMode(libusb_device_handle *dev){
+    stream_mode_info_t info;
+    int r = vendorIn(dev, VENDOR_REQ_GetMode, 0, &info, sizeof(info));
+    if(r != sizeof(info)){
+        fprintf(stderr, "GET_MODE failed: %s\n", r < 0 ? libusb_strerror(r) : "short reply");
+        return 1;
+    }
+    // The firmware is little endian as well
+    printf("mode:    %s\n", info.mode < MODE_COUNT ? mode_names[info.mode] : "unknown");
+    printf("since:   packet %u\n", info.since);
+    printf("packets: %u\n", info.packets);
+    return 0;
+}
+
+static int readCounters(libusb_device_handle *dev, perf_counters_t *c){
+    int r = vendorIn(dev, VENDOR_REQ_GetCounters, 0, c, sizeof(*c));
+    if(r != sizeof(*c)){
+        fprintf(stderr, "GET_COUNTERS failed: %s%s\n", r < 0 ? libusb_strerror(r) : "short reply",
+                r == LIBUSB_ERROR_PIPE ? ", firmware built without PERF_COUNTERS?" : "");
+        return 1;
+    }
+    return 0;
+}
+
+// With ms, reads the counters twice that far apart and also shows the rates, timed by the device's USB frames
+static int getCounters(libusb_device_handle *dev, unsigned long ms){
+    perf_counters_t c, before;
+    if(readCounters(dev, &before))
+        return 1;
+    c = before;
+    if(ms){
+        usleep(ms * 1000);
+        if(readCounters(dev, &c))
+            return 1;
+    }
+
+    printf("samples per channel: %u\n", c.samples);
+    printf("extractor in:        %u bytes\n", c.extractor_in);
+    printf("extractor out:       %u bytes\n", c.extractor_out);
+    printf("extractor discarded: %u bits\n", 8 * (c.extractor_in - c.extractor_out));
+    printf("bytes sent:          %u\n", c.bytes_sent);
+    printf("endpoint timeouts:   %u\n", c.timeouts);
+    printf("sampler overruns:    %u\n", c.sampler_overruns);
+    printf("health failures:     %u\n", c.health_failures);
+    printf("USB frames:          %u\n", c.frames);
+    printf("short packets:       %u\n", c.short_packets);
+    if(ms){
+        uint16_t frames = c.frames - before.frames;
+        uint32_t sent = c.bytes_sent - before.bytes_sent;
+        printf("rates:               %.1f bytes/s, %.2f samples/ms, %u short packets in %u frames\n",
+               frames ? 1000.0 * sent / frames : 0.0, frames ? (double)(c.samples - before.samples) / frames : 0.0,
+               (uint16_t)(c.short_packets - before.short_packets), frames);
+    }
+    return 0;
+}
+
+static int getSampling(libusb_device_handle *dev){
+    sampling_info_t info;
+    int r = vendorIn(dev, VENDOR_REQ_GetSampling, 0, &info, sizeof(info));
+    if(r != sizeof(info)){
+        fprintf(stderr, "GET_SAMPLING failed: %s\n", r < 0 ? libusb_strerror(r) : "short reply");
+        return 1;
+    }
+    printf("period:  %u ticks of %u Hz, %.0f samples/s\n", info.period, info.clock_hz, (double)info.clock_hz / info.period);
+    printf("fold:    %u\n", info.fold);
+    return 0;
+}
+
+static int setSampling(libusb_device_handle *dev, unsigned long period, unsigned long fold){
+    int r = vendorOut(dev, VENDOR_REQ_SetSampling, period, fold);
+    if(r < 0){
+        fprintf(stderr, "SET_SAMPLING failed: %s%s\n", libusb_strerror(r),
+                r == LIBUSB_ERROR_PIPE ? ", period 10 to 256 and fold 1, 2 or 4" : "");
+        return 1;
+    }
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    uint8_t classes;
+} trace_classes[] = {
+    { "sampler", TRACE_CLASS_Sampler },
+    { "usbgen",  TRACE_CLASS_USBGen },
+    { "control", TRACE_CLASS_Control },
+    { "bank",    TRACE_CLASS_Bank },
+    { "wait",    TRACE_CLASS_Wait },
+    { "all",     0xFF },
+};
+#define TRACE_CLASS_COUNT (sizeof(trace_classes) / sizeof(trace_classes[0]))
+
+/* Writes count GET_TRACE replies to stdout for usbrng-trace, each preceded by its length, and turns tracing off again
+ * with the last one. The first reply only holds whatever was traced before.
+ */
+static int trace(libusb_device_handle *dev, char *names, unsigned long count){
+    uint8_t classes = 0;
+    for(char *name=strtok(names, ","); name; name=strtok(NULL, ",")){
+        uint8_t i;
+        for(i=0; i<TRACE_CLASS_COUNT && strcmp(name, trace_classes[i].name); i++);
+        if(i == TRACE_CLASS_COUNT){
+            fprintf(stderr, "unknown trace class %s\n", name);
+            return 2;
+        }
+        classes |= trace_classes[i].classes;
+    }
+
+    for(unsigned long i=0; i<=count; i++){
+        uint8_t buf[1024];
+        int r = vendorIn(dev, VENDOR_REQ_GetTrace, i < count ? classes : 0, buf + 2, sizeof(buf) - 2);
+        if(r < 0){
+            fprintf(stderr, "GET_TRACE failed: %s%s\n", libusb_strerror(r),
+                    r == LIBUSB_ERROR_PIPE ? ", firmware built without TRACE?" : "");
+            return 1;
+        }
+        buf[0] = r;
+        buf[1] = r >> 8;
+        if(fwrite(buf, 1, r + 2, stdout) != (size_t)r + 2){
+            perror("write");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int setMode(libusb_device_handle *dev, const char *name){
+    for(uint8_t i=0; i<MODE_COUNT; i++){
+        if(strcmp(name, mode_names[i]))
+            continue;
+        int r = vendorOut(dev, VENDOR_REQ_SetMode, i, 0);
+        if(r < 0){
+            fprintf(stderr, "SET_MODE failed: %s\n", libusb_strerror(r));
+            return 1;
+        }
+        return 0;
+    }
+    fprintf(stderr, "unknown mode %s\n", name);
+    return 2;
+}
+
+static void usage(const char *name){
+    fprintf(stderr,
+            "usage: %s mode [noise|drbg|pattern] | sampling [period [fold]] | counters [ms] | trace classes [dumps]\n"
+            "  mode          show the stream mode and from which packet on it applies\n"
+            "  mode <name>   switch the stream mode at the next packet boundary\n"
+            "  sampling      show the sample period and fold factor\n"
+            "  sampling period [fold]\n"
+            "                sample every period ticks of the sampler clock and XOR fold samples into one, default 1\n"
+            "  counters [ms] show the performance counters, and the rates over ms if given; the frame count wraps after\n"
+            "                65 s. Needs firmware built with PERF_COUNTERS, see firmware/main.h\n"
+            "  trace classes [dumps]\n"
+            "                trace sampler,usbgen,control,bank,wait or all and write the dumps, default 100, to stdout\n"
+            "                for usbrng-trace\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    if(argc < 2)
+        usage(argv[0]);
+
+    int r = libusb_init(NULL);
+    if(r < 0){
+        fprintf(stderr, "libusb_init: %s\n", libusb_strerror(r));
+        return 1;
+    }
+    libusb_device_handle *dev = openDevice();
+
+    int status = 2;
+    if(!strcmp(argv[1], "mode") && argc == 2)
+        status = getMode(dev);
+    else if(!strcmp(argv[1], "mode") && argc == 3)
+        status = setMode(dev, argv[2]);
+    else if(!strcmp(argv[1], "sampling") && argc == 2)
+        status = getSampling(dev);
+    else if(!strcmp(argv[1], "sampling") && (argc == 3 || argc == 4))
+        status = setSampling(dev, strtoul(argv[2], NULL, 0), argc == 4 ? strtoul(argv[3], NULL, 0) : 1);
+    else if(!strcmp(argv[1], "counters") && (argc == 2 || argc == 3))
+        status = getCounters(dev, argc == 3 ? strtoul(argv[2], NULL, 0) : 0);
+    else if(!strcmp(argv[1], "trace") && (argc == 3 || argc == 4))
+        status = trace(dev, argv[2], argc == 4 ? strtoul(argv[3], NULL, 0) : 100);
+    else
+        usage(argv[0]);
+
+    libusb_close(dev);
+    libusb_exit(NULL);
+    return status;
+}
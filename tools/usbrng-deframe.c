@@ -0,0 +1,198 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../firmware/main.h"
+
+/* Checks the frames of a FRAMED_STREAM build (see firmware/main.h) read from a file or stdin and writes their payload
+ * to stdout, e.g.
+ *     usbrng-deframe -m noise /dev/ttyACM0 | consumer
+ * Frames that fail the CRC are dropped and the parser resynchronises on the next offset that holds a valid frame.
+ * With -m, payload produced in any other mode is dropped as well. Statistics go to stderr, and the exit status is 1
+ * if anything was lost, corrupted, dropped or produced while a health test was failing.
+ *
+ * The sequence number is only 8 bits wide, so a gap of 256 frames or more is counted modulo 256.
+ */
+
+#define MODES 4
+
+static const char *mode_names[MODES] = {
+    [STREAM_MODE_Noise]   = "noise",
+    [STREAM_MODE_DRBG]    = "drbg",
+    [STREAM_MODE_Pattern] = "pattern",
+    [3]                   = "unknown",
+};
+
+typedef struct {
+    uint64_t frames;
+    uint64_t payload;
+    uint64_t lost;
+    uint64_t restarts;
+    uint64_t corrupt;
+    uint64_t dropped;
+    uint64_t unhealthy;
+    uint64_t mode_frames[MODES];
+    uint64_t mode_changes;
+
+    bool synced;
+    uint8_t seq;
+    uint8_t mode;
+} stats_t;
+
+static uint16_t crc_table[256];
+
+// CRC-16/XMODEM, the same as _crc_xmodem_update in the firmware, a byte at a time
+static void crcInit(){
+    for(uint16_t i=0; i<256; i++){
+        uint16_t crc = i << 8;
+        for(uint8_t j=0; j<8; j++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        crc_table[i] = crc;
+    }
+}
+
+static uint16_t crc16(const uint8_t *p, size_t len){
+    uint16_t crc = 0;
+    while(len--)
+        crc = (crc << 8) ^ crc_table[(crc >> 8) ^ *p++];
+    return crc;
+}
+
+static bool crcOK(const uint8_t *p, size_t len){
+    return crc16(p, len - FRAME_CRC_SIZE) == (p[len - 2] | (p[len - 1] << 8));
+}
+
+// Returns whether the payload of the frame at p should be passed on
+static bool frame(stats_t *s, const uint8_t *p, int want_mode){
+    uint8_t mode = p[0] >> FRAME_MODE_SHIFT;
+    uint8_t seq = p[1];
+    uint8_t status = p[2];
+
+    s->frames++;
+    s->mode_frames[mode]++;
+    if(s->synced){
+        if(status & FRAME_FLAG_Start)
+            s->restarts++;
+        else
+            s->lost += (uint8_t)(seq - s->seq - 1);
+        if(mode != s->mode)
+            s->mode_changes++;
+    }
+    s->synced = true;
+    s->seq = seq;
+    s->mode = mode;
+
+    if(status & FRAME_HEALTH_MASK)
+        s->unhealthy++;
+    if(want_mode >= 0 && mode != want_mode){
+        s->dropped++;
+        return false;
+    }
+    return true;
+}
+
+static void usage(const char *name){
+    fprintf(stderr, "usage: %s [-m noise|drbg|pattern] [-c bytes] [file]\n"
+            "  -m  only pass on the payload of frames produced in this mode\n"
+            "  -c  stop after this many bytes of input, default: at end of input\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    int want_mode = -1;
+    uint64_t limit = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "m:c:")) != -1){
+        switch(opt){
+        case 'm':
+            for(want_mode=0; want_mode<STREAM_MODE_Pattern+1; want_mode++)
+                if(!strcmp(optarg, mode_names[want_mode]))
+                    break;
+            if(want_mode > STREAM_MODE_Pattern)
+                usage(argv[0]);
+            break;
+        case 'c': limit = strtoull(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+    if(argc - optind > 1)
+        usage(argv[0]);
+
+    int fd = 0;
+    if(optind < argc){
+        fd = open(argv[optind], O_RDONLY);
+        if(fd < 0){
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    crcInit();
+
+    stats_t s;
+    memset(&s, 0, sizeof(s));
+    static uint8_t buf[1 << 16], payload[1 << 16];
+    size_t fill = 0;
+    uint64_t total = 0;
+
+    for(;;){
+        ssize_t n = read(fd, buf + fill, sizeof(buf) - fill);
+        if(n <= 0)
+            break;
+        fill += n;
+        total += n;
+
+        size_t pos = 0, out = 0;
+        while(fill - pos >= FRAME_HEADER_SIZE){
+            uint8_t length = buf[pos] & FRAME_LENGTH_MASK;
+            size_t len = FRAME_HEADER_SIZE + length + FRAME_CRC_SIZE;
+            if(length <= FRAME_MAX_PAYLOAD && len > fill - pos)
+                break;
+
+            if(length > FRAME_MAX_PAYLOAD || !crcOK(buf + pos, len)){
+                // Lost or corrupted bytes shift the frame boundaries, resynchronise on the next valid frame
+                s.corrupt++;
+                pos++;
+                continue;
+            }
+
+            if(frame(&s, buf + pos, want_mode)){
+                memcpy(payload + out, buf + pos + FRAME_HEADER_SIZE, length);
+                out += length;
+            }
+            pos += len;
+        }
+        memmove(buf, buf + pos, fill - pos);
+        fill -= pos;
+
+        if(out && fwrite(payload, 1, out, stdout) != out){
+            perror("write");
+            return 1;
+        }
+        s.payload += out;
+
+        if(limit && total >= limit)
+            break;
+    }
+    s.corrupt += fill;
+    fflush(stdout);
+
+    fprintf(stderr, "frames:           %llu\n", (unsigned long long)s.frames);
+    for(uint8_t i=0; i<MODES; i++)
+        if(s.mode_frames[i])
+            fprintf(stderr, "  %-16s%llu\n", mode_names[i], (unsigned long long)s.mode_frames[i]);
+    fprintf(stderr, "payload bytes:    %llu\n", (unsigned long long)s.payload);
+    fprintf(stderr, "lost frames:      %llu\n", (unsigned long long)s.lost);
+    fprintf(stderr, "restarts:         %llu\n", (unsigned long long)s.restarts);
+    fprintf(stderr, "mode changes:     %llu\n", (unsigned long long)s.mode_changes);
+    fprintf(stderr, "corrupt bytes:    %llu\n", (unsigned long long)s.corrupt);
+    fprintf(stderr, "dropped frames:   %llu\n", (unsigned long long)s.dropped);
+    fprintf(stderr, "unhealthy frames: %llu\n", (unsigned long long)s.unhealthy);
+
+    return (s.lost || s.corrupt || s.dropped || s.unhealthy) ? 1 : 0;
+}
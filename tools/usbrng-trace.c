@@ -0,0 +1,254 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "../firmware/trace.h"
+
+/* Renders the event trace of a firmware built with TRACE (see firmware/trace.h). Reads the dumps that
+ *     usbrng-ctl trace control,bank,wait 1000 > dumps
+ * saved, each one a little endian 16 bit length followed by the GET_TRACE reply, from a file or stdin and prints
+ * latency histograms for ISRs, control requests, Endpoint_WaitUntilReady and the stream endpoint, and with -l the
+ * timeline itself.
+ *
+ * Timestamps are unwrapped with the help of the TRACE_Overflow events. Where the firmware overwrote events before
+ * they were dumped the timeline has a gap and the time across it is unknown, so nothing is measured across a gap.
+ */
+
+#define TIMER_HZ_DEFAULT 2000000 // F_CPU/8
+#define BUCKETS 32
+
+enum {
+    HIST_Sampler,
+    HIST_USBGen,
+    HIST_Control,
+    HIST_Wait,
+    HIST_Commit,  // from one bank commit to the next
+    HIST_Blocked, // from running out of banks to the next commit
+    HISTS,
+};
+
+static const char *hist_names[HISTS] = {
+    [HIST_Sampler] = "sampler ISR",
+    [HIST_USBGen]  = "USB_GEN_vect",
+    [HIST_Control] = "control request handling",
+    [HIST_Wait]    = "Endpoint_WaitUntilReady",
+    [HIST_Commit]  = "between bank commits",
+    [HIST_Blocked] = "banks full until next commit",
+};
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[BUCKETS];
+} hist_t;
+
+typedef struct {
+    hist_t hists[HISTS];
+    uint64_t events;
+    uint64_t dumps;
+    uint64_t gaps;
+    uint64_t lost;
+    uint64_t timeouts;
+
+    bool synced;
+    uint16_t last;
+    uint64_t epoch;
+    uint64_t start;
+    uint64_t previous;
+
+    // Start of every open interval, 0 if none
+    uint64_t open[HISTS];
+} trace_state_t;
+
+static double timer_hz = TIMER_HZ_DEFAULT;
+static bool timeline;
+
+static double us(uint64_t ticks){
+    return ticks * 1e6 / timer_hz;
+}
+
+static const char *eventName(uint8_t event){
+    switch(event){
+    case TRACE_Overflow:     return "overflow";
+    case TRACE_SamplerEnter: return "sampler enter";
+    case TRACE_SamplerExit:  return "sampler exit";
+    case TRACE_USBGenEnter:  return "usb gen enter";
+    case TRACE_USBGenExit:   return "usb gen exit";
+    case TRACE_ControlEnter: return "control enter";
+    case TRACE_ControlExit:  return "control exit";
+    case TRACE_BankCommit:   return "bank commit";
+    case TRACE_BanksFull:    return "banks full";
+    case TRACE_WaitEnter:    return "wait enter";
+    case TRACE_WaitExit:     return "wait exit";
+    default:                 return "unknown";
+    }
+}
+
+static void record(hist_t *h, uint64_t ticks){
+    uint8_t bucket = 0;
+    while(bucket < BUCKETS-1 && (ticks >> (bucket + 1)))
+        bucket++;
+    h->count++;
+    h->sum += ticks;
+    if(ticks > h->max)
+        h->max = ticks;
+    h->buckets[bucket]++;
+}
+
+// Time is measured to the first matching end after a start; a second start replaces the first
+static void begin(trace_state_t *s, uint8_t hist, uint64_t t){
+    s->open[hist] = t;
+}
+
+static void end(trace_state_t *s, uint8_t hist, uint64_t t){
+    if(s->open[hist])
+        record(&s->hists[hist], t - s->open[hist]);
+    s->open[hist] = 0;
+}
+
+static void event(trace_state_t *s, const trace_entry_t *e){
+    if(s->synced && e->time < s->last)
+        s->epoch += 0x10000;
+    s->last = e->time;
+    // Offset by one period so that 0 can stand for no open interval
+    uint64_t t = s->epoch + e->time + 0x10000;
+    if(!s->synced){
+        s->start = t;
+        s->previous = t;
+        s->synced = true;
+    }
+
+    if(timeline)
+        printf("%12.1f us  %+9.1f  %-14s %u\n", us(t - s->start), us(t - s->previous), eventName(e->event), e->arg);
+    s->previous = t;
+    s->events++;
+
+    switch(e->event){
+    case TRACE_SamplerEnter: begin(s, HIST_Sampler, t); break;
+    case TRACE_SamplerExit:  end(s, HIST_Sampler, t); break;
+    case TRACE_USBGenEnter:  begin(s, HIST_USBGen, t); break;
+    case TRACE_USBGenExit:   end(s, HIST_USBGen, t); break;
+    case TRACE_ControlEnter: begin(s, HIST_Control, t); break;
+    case TRACE_ControlExit:  end(s, HIST_Control, t); break;
+    case TRACE_WaitEnter:    begin(s, HIST_Wait, t); break;
+    case TRACE_WaitExit:
+        end(s, HIST_Wait, t);
+        if(e->arg == 4) // ENDPOINT_READYWAIT_Timeout
+            s->timeouts++;
+        break;
+    case TRACE_BanksFull:
+        if(!s->open[HIST_Blocked])
+            begin(s, HIST_Blocked, t);
+        break;
+    case TRACE_BankCommit:
+        end(s, HIST_Blocked, t);
+        end(s, HIST_Commit, t);
+        begin(s, HIST_Commit, t);
+        break;
+    }
+}
+
+static bool dump(trace_state_t *s, const uint8_t *buf, uint16_t len){
+    if(len < 3 || (len - 3) % sizeof(trace_entry_t))
+        return false;
+
+    uint8_t head = buf[0], count = buf[1], lost = buf[2];
+    uint16_t size = (len - 3) / sizeof(trace_entry_t);
+    if(!size || count > size || head >= size)
+        return false;
+
+    s->dumps++;
+    if(lost){
+        // Whatever was open is not going to be matched correctly any more
+        if(timeline && s->synced)
+            printf("---- %u events lost ----\n", lost);
+        s->gaps++;
+        s->lost += lost;
+        s->synced = false;
+        s->epoch = 0;
+        memset(s->open, 0, sizeof(s->open));
+    }
+
+    const trace_entry_t *entries = (const trace_entry_t *)(buf + 3);
+    for(uint16_t i=0; i<count; i++){
+        trace_entry_t e;
+        memcpy(&e, &entries[(head + size - count + i) % size], sizeof(e));
+        event(s, &e);
+    }
+    return true;
+}
+
+static void printHistogram(const char *name, const hist_t *h){
+    if(!h->count)
+        return;
+
+    uint64_t peak = 0;
+    for(uint8_t i=0; i<BUCKETS; i++)
+        if(h->buckets[i] > peak)
+            peak = h->buckets[i];
+
+    printf("\n%s: %llu, mean %.1f us, max %.1f us\n", name, (unsigned long long)h->count,
+           us(h->sum) / h->count, us(h->max));
+    for(uint8_t i=0; i<BUCKETS; i++){
+        if(!h->buckets[i])
+            continue;
+        char bar[41];
+        uint8_t n = h->buckets[i] * 40 / peak;
+        memset(bar, '#', n);
+        bar[n] = 0;
+        printf("  %9.1f us  %10llu  %s\n", us(i ? 1ULL << i : 0), (unsigned long long)h->buckets[i], bar);
+    }
+}
+
+static void usage(const char *name){
+    fprintf(stderr, "usage: %s [-l] [-f hz] [file]\n"
+            "  -l  print the timeline\n"
+            "  -f  Timer1 frequency, default %u\n", name, TIMER_HZ_DEFAULT);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    int opt;
+
+    while((opt = getopt(argc, argv, "lf:")) != -1){
+        switch(opt){
+        case 'l': timeline = true; break;
+        case 'f': timer_hz = strtod(optarg, NULL); break;
+        default: usage(argv[0]);
+        }
+    }
+    if(argc - optind > 1 || timer_hz <= 0)
+        usage(argv[0]);
+
+    FILE *in = stdin;
+    if(optind < argc){
+        in = fopen(argv[optind], "rb");
+        if(!in){
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    static trace_state_t s;
+    uint8_t header[2];
+    while(fread(header, 1, sizeof(header), in) == sizeof(header)){
+        uint16_t len = header[0] | (header[1] << 8);
+        uint8_t buf[0x10000];
+        if(fread(buf, 1, len, in) != len || !dump(&s, buf, len)){
+            fprintf(stderr, "malformed dump after %llu dumps\n", (unsigned long long)s.dumps);
+            return 1;
+        }
+    }
+
+    printf("dumps:            %llu\n", (unsigned long long)s.dumps);
+    printf("events:           %llu\n", (unsigned long long)s.events);
+    printf("gaps:             %llu (%llu events lost)\n", (unsigned long long)s.gaps, (unsigned long long)s.lost);
+    printf("wait timeouts:    %llu\n", (unsigned long long)s.timeouts);
+    for(uint8_t i=0; i<HISTS; i++)
+        printHistogram(hist_names[i], &s.hists[i]);
+    return 0;
+}
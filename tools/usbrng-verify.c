@@ -0,0 +1,207 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "../firmware/main.h"
+
+/* Checks a test pattern stream (STREAM_MODE_Pattern, see firmware/main.h) read from a file or stdin, e.g.
+ *     usbrng-ctl mode pattern && usbrng-verify /dev/ttyACM0
+ * or for a FRAMED_STREAM build
+ *     usbrng-ctl mode pattern && usbrng-deframe -m pattern /dev/ttyACM0 | usbrng-verify -p 59
+ * and reports sustained throughput, lost, duplicated and corrupted packets and packet latency.
+ *
+ * Latency is the host receive time minus the USB frame number the device wrote the packet in. The two clocks have an
+ * unknown offset, so the figures are relative to the fastest packet seen.
+ */
+
+#define PACKET_SIZE_MAX 64
+#define HEADER_SIZE 6
+// The USB frame number is 11 bits wide
+#define FRAME_MASK 0x7FF
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t lost;
+    uint64_t duplicated;
+    uint64_t restarts;
+    uint64_t skipped;
+    double first;
+    double last;
+
+    bool synced;
+    uint32_t seq;
+    uint16_t frame;
+    int64_t device_ms;
+
+    double *latency;
+    size_t latency_count;
+    size_t latency_size;
+} stats_t;
+
+// Pattern packets are shorter when they come out of usbrng-deframe
+static uint8_t packet_size = PACKET_SIZE_MAX;
+
+static double now(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool isPacket(const uint8_t *p){
+    uint8_t seq = p[0];
+    for(uint8_t i=HEADER_SIZE; i<packet_size; i++)
+        if(p[i] != (uint8_t)(seq + i))
+            return false;
+    return true;
+}
+
+static void addLatency(stats_t *s, double ms){
+    if(s->latency_count == s->latency_size){
+        s->latency_size = s->latency_size ? 2*s->latency_size : 4096;
+        s->latency = realloc(s->latency, s->latency_size * sizeof(double));
+        if(!s->latency){
+            perror("realloc");
+            exit(1);
+        }
+    }
+    s->latency[s->latency_count++] = ms;
+}
+
+static void packet(stats_t *s, const uint8_t *p, double t){
+    uint32_t seq = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    uint16_t frame = (p[4] | (p[5] << 8)) & FRAME_MASK;
+
+    if(!s->packets)
+        s->first = t;
+    s->last = t;
+    s->packets++;
+    s->bytes += packet_size;
+
+    if(s->synced){
+        if(seq < s->seq / 2 || (seq == 0 && s->seq)){
+            /* The mode was re-entered or the device restarted. The first packets of the new run may be lost as well,
+             * so any jump back to below half the last number counts.
+             */
+            s->restarts++;
+            s->lost += seq;
+        }else if(seq <= s->seq){
+            s->duplicated++;
+            return;
+        }else{
+            s->lost += seq - s->seq - 1;
+        }
+        s->device_ms += (frame - s->frame) & FRAME_MASK;
+    }
+    s->synced = true;
+    s->seq = seq;
+    s->frame = frame;
+    addLatency(s, t*1000 - s->device_ms);
+}
+
+static int compare(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const stats_t *s, double p){
+    size_t i = (size_t)(p / 100 * (s->latency_count - 1) + 0.5);
+    return s->latency[i] - s->latency[0];
+}
+
+static void usage(const char *name){
+    fprintf(stderr, "usage: %s [-c bytes] [-p size] [file]\n"
+            "  -c  stop after this many bytes, default: at end of input\n"
+            "  -p  packet size, default 64. The payload of a FRAMED_STREAM build is %d\n", name, FRAME_MAX_PAYLOAD);
+    exit(2);
+}
+
+int main(int argc, char **argv){
+    uint64_t limit = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "c:p:")) != -1){
+        switch(opt){
+        case 'c': limit = strtoull(optarg, NULL, 0); break;
+        case 'p': {
+            unsigned long size = strtoul(optarg, NULL, 0);
+            if(size <= HEADER_SIZE || size > PACKET_SIZE_MAX)
+                usage(argv[0]);
+            packet_size = size;
+            break;
+        }
+        default: usage(argv[0]);
+        }
+    }
+    if(argc - optind > 1)
+        usage(argv[0]);
+
+    int fd = 0;
+    if(optind < argc){
+        fd = open(argv[optind], O_RDONLY);
+        if(fd < 0){
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    stats_t s;
+    memset(&s, 0, sizeof(s));
+    uint8_t buf[16*PACKET_SIZE_MAX];
+    size_t fill = 0;
+    uint64_t total = 0;
+
+    for(;;){
+        ssize_t n = read(fd, buf + fill, sizeof(buf) - fill);
+        if(n <= 0)
+            break;
+        double t = now();
+        fill += n;
+        total += n;
+
+        // Byte loss shifts the packet boundaries, so resynchronise on the first offset that looks like a packet
+        size_t pos = 0;
+        while(fill - pos >= packet_size){
+            if(isPacket(buf + pos)){
+                packet(&s, buf + pos, t);
+                pos += packet_size;
+            }else{
+                s.skipped++;
+                pos++;
+            }
+        }
+        memmove(buf, buf + pos, fill - pos);
+        fill -= pos;
+
+        if(limit && total >= limit)
+            break;
+    }
+    s.skipped += fill;
+
+    double elapsed = s.last - s.first;
+    printf("bytes:            %llu\n", (unsigned long long)s.bytes);
+    printf("packets:          %llu\n", (unsigned long long)s.packets);
+    printf("lost packets:     %llu\n", (unsigned long long)s.lost);
+    printf("duplicated:       %llu\n", (unsigned long long)s.duplicated);
+    printf("restarts:         %llu\n", (unsigned long long)s.restarts);
+    printf("skipped bytes:    %llu\n", (unsigned long long)s.skipped);
+    // The first read only marks the start
+    printf("throughput:       %.0f bytes/s\n", elapsed > 0 ? (s.bytes - packet_size) / elapsed : 0.0);
+
+    if(s.latency_count){
+        qsort(s.latency, s.latency_count, sizeof(double), compare);
+        printf("latency p50:      %.3f ms\n", percentile(&s, 50));
+        printf("latency p90:      %.3f ms\n", percentile(&s, 90));
+        printf("latency p99:      %.3f ms\n", percentile(&s, 99));
+        printf("latency p99.9:    %.3f ms\n", percentile(&s, 99.9));
+        printf("latency max:      %.3f ms\n", percentile(&s, 100));
+    }
+    free(s.latency);
+
+    return (s.lost || s.duplicated || s.skipped) ? 1 : 0;
+}